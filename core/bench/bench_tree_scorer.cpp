@@ -0,0 +1,66 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+// Benchmarks of scoring one row at a time with a saved tree (tree_scorer.h), over the tree depth.
+// Usage: bench_tree_scorer [--benchmark_filter=<regex>]
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "tree_scorer.h"
+
+namespace {
+
+// A tree file of a complete depth `depth` tree on `num_features` features with random splits and actions
+std::string random_tree(int depth, size_t num_features, size_t num_actions, std::mt19937_64& rng) {
+  size_t num_nodes = (static_cast<size_t>(1) << (depth + 1)) - 1;
+  size_t num_splits = num_nodes / 2;
+  std::normal_distribution<double> normal;
+  std::uniform_int_distribution<size_t> feature(1, num_features);
+  std::uniform_int_distribution<size_t> action(1, num_actions);
+  std::vector<double> tree_array(4 * num_nodes, 0.0);
+  for (size_t j = 0; j < num_nodes; j++) {
+    if (j < num_splits) {
+      tree_array[j] = static_cast<double>(feature(rng));
+      tree_array[num_nodes + j] = normal(rng);
+      tree_array[2 * num_nodes + j] = static_cast<double>(2 * j + 2);
+      tree_array[3 * num_nodes + j] = static_cast<double>(2 * j + 3);
+    } else {
+      tree_array[j] = -1;
+      tree_array[num_nodes + j] = static_cast<double>(action(rng));
+    }
+  }
+  return serialize_tree(tree_array.data(), num_nodes, std::vector<std::string>(num_features, "x"),
+                        std::vector<std::string>(num_actions, "a"));
+}
+
+// Args: depth (on 10 features with 3 actions, each iteration scores one of 1024 random rows)
+void BM_score_row(benchmark::State& state) {
+  size_t num_features = 10;
+  size_t num_rows = 1024;
+  std::mt19937_64 rng(42);
+  std::string bytes = random_tree(static_cast<int>(state.range(0)), num_features, 3, rng);
+  TreeScorer scorer(bytes.data(), bytes.size());
+  std::normal_distribution<double> normal;
+  std::vector<double> rows(num_rows * num_features);
+  for (auto& x : rows) {
+    x = normal(rng);
+  }
+
+  size_t row = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(scorer.predict(&rows[row * num_features]));
+    row = (row + 1) % num_rows;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_score_row)->ArgName("depth")->DenseRange(1, 6)->Arg(10);
+
+} // namespace
+
+BENCHMARK_MAIN();
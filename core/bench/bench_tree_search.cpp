@@ -0,0 +1,169 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+// Benchmarks of exact tree search, sweeping one parameter at a time from a base problem.
+// Usage: bench_tree_search [--benchmark_filter=<regex>] [--benchmark_out=<file> --benchmark_out_format=json]
+// (compare two runs with Google Benchmark's tools/compare.py).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <benchmark/benchmark.h>
+
+#include "tree_search.h"
+
+namespace {
+
+// Reset the peak resident set size of the process to its current size (Linux only, otherwise a no-op)
+void reset_peak_rss() {
+  std::FILE* file = std::fopen("/proc/self/clear_refs", "w");
+  if (file != nullptr) {
+    std::fputs("5", file);
+    std::fclose(file);
+  }
+}
+
+// The peak resident set size (in bytes) since `reset_peak_rss`, or since the process started
+double peak_rss() {
+  std::FILE* file = std::fopen("/proc/self/status", "r");
+  if (file != nullptr) {
+    char line[256];
+    long kilobytes = -1;
+    while (std::fgets(line, sizeof(line), file) != nullptr) {
+      if (std::strncmp(line, "VmHWM:", 6) == 0) {
+        kilobytes = std::strtol(line + 6, nullptr, 10);
+        break;
+      }
+    }
+    std::fclose(file);
+    if (kilobytes >= 0) {
+      return 1024.0 * kilobytes;
+    }
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return 1024.0 * usage.ru_maxrss;
+}
+
+// Random data as in tests/valgrind: continuous features are standard normal (`cardinality` 0), discrete
+// features uniform on `cardinality` values, and the rewards standard normal
+struct Problem {
+  Problem(size_t num_rows, size_t num_features, size_t num_rewards, size_t cardinality) :
+  X(num_rows * num_features), Y(num_rows * num_rewards) {
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> normal;
+    if (cardinality == 0) {
+      std::generate(X.begin(), X.end(), [&]() { return normal(rng); });
+    } else {
+      std::uniform_int_distribution<size_t> discrete(1, cardinality);
+      std::generate(X.begin(), X.end(), [&]() { return static_cast<double>(discrete(rng)); });
+    }
+    std::generate(Y.begin(), Y.end(), [&]() { return normal(rng); });
+  }
+
+  std::vector<double> X;
+  std::vector<double> Y;
+};
+
+// Args: n, p, d, depth, split_step, cardinality
+void BM_tree_search(benchmark::State& state) {
+  size_t num_rows = state.range(0);
+  size_t num_features = state.range(1);
+  size_t num_rewards = state.range(2);
+  int depth = static_cast<int>(state.range(3));
+  SearchOptions options;
+  options.split_step = static_cast<int>(state.range(4));
+  Problem problem(num_rows, num_features, num_rewards, state.range(5));
+  Data data(problem.X.data(), problem.Y.data(), num_rows, num_features, num_rewards);
+
+  // the root split positions: between each pair of adjacent distinct values of a feature, every
+  // `split_step`th (about)
+  size_t root_candidates = 0;
+  if (depth > 0) {
+    for (size_t cardinality : summarize_data(&data, true).cardinality) {
+      root_candidates += (cardinality - 1 + options.split_step - 1) / options.split_step;
+    }
+  }
+
+  reset_peak_rss();
+  SearchStats stats;
+  for (auto _ : state) {
+    stats = SearchStats();
+    std::unique_ptr<Node> tree = tree_search(depth, options, &data, &stats);
+    benchmark::DoNotOptimize(tree.get());
+  }
+
+  double iterations = static_cast<double>(state.iterations());
+  state.counters["root_candidates/s"] = benchmark::Counter(iterations * root_candidates, benchmark::Counter::kIsRate);
+  state.counters["subtrees/s"] = benchmark::Counter(iterations * stats.num_subtrees, benchmark::Counter::kIsRate);
+  // the share of subtrees skipped by bound pruning
+  state.counters["pruned"] = static_cast<double>(stats.num_pruned) / std::max(stats.num_subtrees, static_cast<size_t>(1));
+  state.counters["peak_rss"] = benchmark::Counter(peak_rss(), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+}
+
+// The base problem every sweep varies one parameter of: a depth 2 tree on 1000 samples of 10
+// continuous features with 3 actions (or, to keep the run time of depth 3 down, 200 samples of 4 features)
+const int64_t N = 1000, P = 10, D = 3, DEPTH = 2, STEP = 1, CONTINUOUS = 0;
+
+void sweep_n(benchmark::internal::Benchmark* b) {
+  for (int64_t n : {250, 500, 1000, 2000}) {
+    b->Args({n, P, D, DEPTH, STEP, CONTINUOUS});
+  }
+}
+
+void sweep_p(benchmark::internal::Benchmark* b) {
+  for (int64_t p : {2, 5, 10, 20}) {
+    b->Args({N, p, D, DEPTH, STEP, CONTINUOUS});
+  }
+}
+
+void sweep_d(benchmark::internal::Benchmark* b) {
+  for (int64_t d : {2, 3, 5, 10, 20}) {
+    b->Args({N, P, d, DEPTH, STEP, CONTINUOUS});
+  }
+}
+
+void sweep_depth(benchmark::internal::Benchmark* b) {
+  for (int64_t depth : {0, 1, 2, 3}) {
+    b->Args({200, 4, D, depth, STEP, CONTINUOUS});
+  }
+}
+
+void sweep_split_step(benchmark::internal::Benchmark* b) {
+  for (int64_t step : {1, 2, 5, 10}) {
+    b->Args({N, P, D, DEPTH, step, CONTINUOUS});
+  }
+}
+
+void sweep_cardinality(benchmark::internal::Benchmark* b) {
+  // (the last is continuous)
+  for (int64_t cardinality : {2, 6, 20, 100, 0}) {
+    b->Args({N, P, D, DEPTH, STEP, cardinality});
+  }
+  b->Args({200, 4, D, 3, STEP, 20});
+}
+
+#define POLICYTREE_SWEEP(name, sweep)                                \
+  BENCHMARK(BM_tree_search)->Name("tree_search/" name)->Apply(sweep) \
+    ->ArgNames({"n", "p", "d", "depth", "step", "card"})             \
+    ->Unit(benchmark::kMillisecond)->UseRealTime()
+
+POLICYTREE_SWEEP("n", sweep_n);
+POLICYTREE_SWEEP("p", sweep_p);
+POLICYTREE_SWEEP("d", sweep_d);
+POLICYTREE_SWEEP("depth", sweep_depth);
+POLICYTREE_SWEEP("split_step", sweep_split_step);
+POLICYTREE_SWEEP("cardinality", sweep_cardinality);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,138 @@
+/* Policy Tree (policytree).
+ * https://github.com/grf-labs/policytree
+ * Distributed under the MIT License.
+ */
+
+#ifndef POLICYTREE_H
+#define POLICYTREE_H
+
+#include <stddef.h>
+
+/**
+ * A plain C interface to fit and predict policy trees (see `tree_search.h` for the C++ interface this wraps).
+ *
+ * Matrices are dense, column major arrays of doubles: X is num_rows x num_features (the covariates) and
+ * rewards is num_rows x num_actions (the reward of each action for each sample). Actions and features
+ * are 0-indexed. Every function returns a status (POLICYTREE_OK on success) instead of throwing; the
+ * message of the last error on the calling thread is returned by `policytree_last_error`.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  POLICYTREE_OK = 0,
+  /* An argument is invalid (e.g. a negative depth, or missing values in X) */
+  POLICYTREE_INVALID_ARGUMENT = 1,
+  POLICYTREE_OUT_OF_MEMORY = 2,
+  POLICYTREE_ERROR = 3
+};
+
+/* The tuning parameters of tree search (see `SearchOptions` in tree_search.h) */
+typedef struct policytree_options {
+  /* Only split at every `split_step`th sample along a feature */
+  int split_step;
+  /* The smallest number of samples in a leaf */
+  size_t min_node_size;
+  /* If greater than zero (then at least 2), bin each feature into at most `max_bins` (quantile) bins */
+  size_t max_bins;
+  /* Skip subtrees that can not be part of the optimal tree (nonzero, this does not change the tree) */
+  int bound_pruning;
+  /* The number of threads (0 uses all available cores) */
+  size_t num_threads;
+  /* If greater than zero, stop after `time_limit` seconds (which can not be negative), or once
+     `max_evaluations` root split positions have been searched, and return the best tree found so far */
+  double time_limit;
+  size_t max_evaluations;
+  /* The bytes to cache depth one subtrees of a depth >= 3 search in (0 disables the cache) */
+  size_t cache_memory;
+  /* Search the distinct rows of X, each counted as the number of its samples (nonzero) */
+  int collapse_duplicates;
+} policytree_options;
+
+/* The work done by a tree search (see `SearchStats` in tree_search.h) */
+typedef struct policytree_stats {
+  size_t num_subtrees;
+  size_t num_pruned;
+  size_t num_cache_hits;
+  size_t num_cache_misses;
+  /* Nonzero if the search ran to completion (zero if it stopped at a limit) */
+  int complete;
+  double fraction_searched;
+} policytree_stats;
+
+/* A fitted tree */
+typedef struct policytree_tree policytree_tree;
+
+/* Set `options` to the defaults (those of the R package's `policy_tree`) */
+void policytree_default_options(policytree_options* options);
+
+/**
+ * Fit the depth `depth` tree that maximizes the sum of `rewards`.
+ *
+ * @param X The covariates (num_rows x num_features).
+ * @param rewards The rewards (num_rows x num_actions).
+ * @param sample_weights Optional non-negative weights that multiply each sample's rewards (NULL for unit
+ *  weights); samples with weight zero are left out.
+ * @param options The search options (NULL for the defaults).
+ * @param tree The fitted tree is returned here, to be freed with `policytree_free`.
+ * @param stats If not NULL, the search counters are written here.
+ */
+int policytree_fit(const double* X,
+                   const double* rewards,
+                   const double* sample_weights,
+                   size_t num_rows,
+                   size_t num_features,
+                   size_t num_actions,
+                   int depth,
+                   const policytree_options* options,
+                   policytree_tree** tree,
+                   policytree_stats* stats);
+
+/**
+ * Predict the action of every row of X (num_rows x num_features, the features the tree was fitted on),
+ * written to actions[row], on `num_threads` threads (0 uses all available cores).
+ */
+int policytree_predict(const policytree_tree* tree,
+                       const double* X,
+                       size_t num_rows,
+                       size_t num_features,
+                       size_t num_threads,
+                       size_t* actions);
+
+/* The depth of the tree as fitted (every leaf is at most this deep) */
+int policytree_depth(const policytree_tree* tree);
+
+/* The reward of the tree on the samples it was fitted on */
+double policytree_reward(const policytree_tree* tree);
+
+/**
+ * The number of nodes in the array representation of the tree (2^(depth + 1) - 1, with the nodes of
+ * a smaller tree padded with zero rows), and the array itself: a column major num_nodes x 4 matrix
+ * with a row per node in breadth first order, holding split_variable (-1 if leaf) | split_value
+ * (action if leaf) | left_child | right_child, all 1-indexed. This is the `tree_array` of the R package.
+ */
+size_t policytree_num_nodes(const policytree_tree* tree);
+void policytree_tree_array(const policytree_tree* tree, double* tree_array);
+
+/**
+ * Write the tree to a tree file at `path`, which the header-only scorer `tree_scorer.h` loads to predict
+ * one row at a time. The names of the features and actions are optional (NULL for X1, X2, ... and
+ * 1, 2, ..., the defaults of the R package, which reads the file with `read_policy_tree`).
+ */
+int policytree_save(const policytree_tree* tree,
+                    const char* path,
+                    const char* const* feature_names,
+                    const char* const* action_names);
+
+void policytree_free(policytree_tree* tree);
+
+/* The message of the last error on this thread (empty if there was none) */
+const char* policytree_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* POLICYTREE_H */
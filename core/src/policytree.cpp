@@ -0,0 +1,251 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <new>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "policytree.h"
+#include "tree_predict.h"
+#include "tree_scorer.h"
+#include "tree_search.h"
+
+struct policytree_tree {
+  policytree_tree(std::vector<double> tree_array, size_t num_nodes, int depth, double reward, size_t num_features,
+                  size_t num_actions) :
+  tree_array(std::move(tree_array)), num_nodes(num_nodes), depth(depth), reward(reward), num_features(num_features),
+  num_actions(num_actions), predict_tree(this->tree_array.data(), num_nodes) {
+  }
+
+  // The R package's `tree_array` (see `policytree_tree_array`)
+  std::vector<double> tree_array;
+  size_t num_nodes;
+  int depth;
+  double reward;
+  size_t num_features;
+  size_t num_actions;
+  PredictTree predict_tree;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+// Run `body`, returning its status and recording the message of an exception it throws
+template <typename Body>
+int guard(const Body& body) {
+  try {
+    body();
+    last_error.clear();
+    return POLICYTREE_OK;
+  } catch (const std::invalid_argument& e) {
+    last_error = e.what();
+    return POLICYTREE_INVALID_ARGUMENT;
+  } catch (const std::bad_alloc&) {
+    last_error = "Out of memory.";
+    return POLICYTREE_OUT_OF_MEMORY;
+  } catch (const std::exception& e) {
+    last_error = e.what();
+    return POLICYTREE_ERROR;
+  } catch (...) {
+    last_error = "Unknown error.";
+    return POLICYTREE_ERROR;
+  }
+}
+
+// The tree as the R package's `tree_array`, with the nodes in breadth first order (as `tree_to_list`)
+std::vector<double> tree_to_array(const Node* root, size_t num_nodes) {
+  std::vector<double> tree_array(4 * num_nodes, 0.0);
+  size_t i = 1;
+  size_t j = 0;
+  std::queue<const Node*> frontier;
+  frontier.push(root);
+  while (!frontier.empty()) {
+    const Node* node = frontier.front();
+    frontier.pop();
+    if (node->left_child == nullptr) {
+      tree_array[j] = -1;
+      tree_array[num_nodes + j] = static_cast<double>(node->action_id + 1);
+    } else {
+      tree_array[j] = static_cast<double>(node->index + 1);
+      tree_array[num_nodes + j] = node->value;
+      tree_array[2 * num_nodes + j] = static_cast<double>(i + 1);
+      tree_array[3 * num_nodes + j] = static_cast<double>(i + 2);
+      frontier.push(node->left_child.get());
+      frontier.push(node->right_child.get());
+      i += 2;
+    }
+    j++;
+  }
+
+  return tree_array;
+}
+
+// `count` names, those of `names` or (if it is null) `prefix` followed by 1, 2, ...
+std::vector<std::string> names_or_default(const char* const* names, size_t count, const std::string& prefix) {
+  std::vector<std::string> result(count);
+  for (size_t j = 0; j < count; j++) {
+    result[j] = names != nullptr ? std::string(names[j]) : prefix + std::to_string(j + 1);
+  }
+  return result;
+}
+
+} // namespace
+
+extern "C" {
+
+void policytree_default_options(policytree_options* options) {
+  SearchOptions defaults;
+  options->split_step = defaults.split_step;
+  options->min_node_size = defaults.min_node_size;
+  options->max_bins = defaults.max_bins;
+  options->bound_pruning = defaults.bound_pruning ? 1 : 0;
+  options->num_threads = 0;
+  options->time_limit = defaults.time_limit;
+  options->max_evaluations = defaults.max_evaluations;
+  options->cache_memory = defaults.cache_memory;
+  options->collapse_duplicates = defaults.collapse_duplicates ? 1 : 0;
+}
+
+int policytree_fit(const double* X,
+                   const double* rewards,
+                   const double* sample_weights,
+                   size_t num_rows,
+                   size_t num_features,
+                   size_t num_actions,
+                   int depth,
+                   const policytree_options* options,
+                   policytree_tree** tree,
+                   policytree_stats* stats) {
+  return guard([&]() {
+    if (X == nullptr || rewards == nullptr || tree == nullptr) {
+      throw std::invalid_argument("X, rewards, and tree can not be NULL.");
+    }
+    if (num_rows == 0 || num_features == 0 || num_actions == 0) {
+      throw std::invalid_argument("X and rewards can not be empty.");
+    }
+    if (depth < 0) {
+      throw std::invalid_argument("depth cannot be negative.");
+    }
+    policytree_options defaults;
+    if (options == nullptr) {
+      policytree_default_options(&defaults);
+      options = &defaults;
+    }
+    if (options->split_step < 1 || options->min_node_size < 1) {
+      throw std::invalid_argument("split_step and min_node_size should be at least 1.");
+    }
+    if (options->max_bins == 1) {
+      throw std::invalid_argument("max_bins should be 0 (no binning) or at least 2.");
+    }
+    if (!(options->time_limit >= 0)) {
+      throw std::invalid_argument("time_limit should be 0 (no limit) or a positive number of seconds.");
+    }
+    SearchOptions search_options;
+    search_options.split_step = options->split_step;
+    search_options.min_node_size = options->min_node_size;
+    search_options.max_bins = options->max_bins;
+    search_options.bound_pruning = options->bound_pruning != 0;
+    search_options.num_threads = options->num_threads;
+    search_options.time_limit = options->time_limit;
+    search_options.max_evaluations = options->max_evaluations;
+    search_options.cache_memory = options->cache_memory;
+    search_options.collapse_duplicates = options->collapse_duplicates != 0;
+
+    Data data(X, rewards, num_rows, num_features, num_actions);
+    DataSummary summary = summarize_data(&data, false);
+    if (summary.missing_x || summary.missing_y) {
+      throw std::invalid_argument("X and rewards can not contain missing values.");
+    }
+    if (sample_weights != nullptr) {
+      for (size_t i = 0; i < num_rows; i++) {
+        if (!(sample_weights[i] >= 0) || std::isinf(sample_weights[i])) {
+          throw std::invalid_argument("sample_weights should be non-negative and finite.");
+        }
+      }
+      data.set_weights(sample_weights);
+    }
+
+    SearchStats search_stats;
+    std::unique_ptr<Node> root = tree_search(depth, search_options, &data, &search_stats);
+    size_t num_nodes = (static_cast<size_t>(1) << (depth + 1)) - 1;
+    *tree = new policytree_tree(tree_to_array(root.get(), num_nodes), num_nodes, depth, root->reward, num_features,
+                                num_actions);
+    if (stats != nullptr) {
+      stats->num_subtrees = search_stats.num_subtrees;
+      stats->num_pruned = search_stats.num_pruned;
+      stats->num_cache_hits = search_stats.num_cache_hits;
+      stats->num_cache_misses = search_stats.num_cache_misses;
+      stats->complete = search_stats.complete ? 1 : 0;
+      stats->fraction_searched = search_stats.fraction_searched;
+    }
+  });
+}
+
+int policytree_predict(const policytree_tree* tree,
+                       const double* X,
+                       size_t num_rows,
+                       size_t num_features,
+                       size_t num_threads,
+                       size_t* actions) {
+  return guard([&]() {
+    if (tree == nullptr || (num_rows > 0 && (X == nullptr || actions == nullptr))) {
+      throw std::invalid_argument("tree, X, and actions can not be NULL.");
+    }
+    if (num_features != tree->num_features) {
+      throw std::invalid_argument("X does not have the number of features the tree was fitted on.");
+    }
+    std::vector<double> result(2 * num_rows);
+    predict_tree(tree->predict_tree, X, num_rows, num_threads, result.data(), result.data() + num_rows);
+    for (size_t i = 0; i < num_rows; i++) {
+      actions[i] = static_cast<size_t>(result[i]) - 1;
+    }
+  });
+}
+
+int policytree_depth(const policytree_tree* tree) {
+  return tree->depth;
+}
+
+double policytree_reward(const policytree_tree* tree) {
+  return tree->reward;
+}
+
+size_t policytree_num_nodes(const policytree_tree* tree) {
+  return tree->num_nodes;
+}
+
+void policytree_tree_array(const policytree_tree* tree, double* tree_array) {
+  std::copy(tree->tree_array.begin(), tree->tree_array.end(), tree_array);
+}
+
+int policytree_save(const policytree_tree* tree,
+                    const char* path,
+                    const char* const* feature_names,
+                    const char* const* action_names) {
+  return guard([&]() {
+    if (tree == nullptr || path == nullptr) {
+      throw std::invalid_argument("tree and path can not be NULL.");
+    }
+    write_tree_file(path, tree->tree_array.data(), tree->num_nodes,
+                    names_or_default(feature_names, tree->num_features, "X"),
+                    names_or_default(action_names, tree->num_actions, ""));
+  });
+}
+
+void policytree_free(policytree_tree* tree) {
+  delete tree;
+}
+
+const char* policytree_last_error(void) {
+  return last_error.c_str();
+}
+
+} // extern "C"
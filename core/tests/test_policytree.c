@@ -0,0 +1,150 @@
+/* Policy Tree (policytree).
+ * https://github.com/grf-labs/policytree
+ * Distributed under the MIT License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "policytree.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+/* A uniform draw on [0, 1) from a linear congruential generator (for a reproducible test) */
+static double uniform(unsigned long* state) {
+  *state = (*state * 6364136223846793005UL + 1442695040888963407UL) & 0xFFFFFFFFFFFFUL;
+  return (double) (*state >> 16) / (double) (1UL << 32);
+}
+
+/* The action of the planted depth two tree: x1 <= 0.5 ? (x2 <= 0.3 ? 0 : 1) : (x3 <= 0.6 ? 2 : 0) */
+static size_t planted_action(const double* X, size_t num_rows, size_t row) {
+  if (X[row] <= 0.5) {
+    return X[num_rows + row] <= 0.3 ? 0 : 1;
+  }
+  return X[2 * num_rows + row] <= 0.6 ? 2 : 0;
+}
+
+static void test_fit_and_predict(void) {
+  size_t num_rows = 500;
+  size_t num_features = 4;
+  size_t num_actions = 3;
+  unsigned long state = 42;
+  double* X = malloc(num_rows * num_features * sizeof(double));
+  double* rewards = malloc(num_rows * num_actions * sizeof(double));
+  size_t* actions = malloc(num_rows * sizeof(size_t));
+  size_t row, j;
+  for (j = 0; j < num_features; j++) {
+    for (row = 0; row < num_rows; row++) {
+      X[j * num_rows + row] = uniform(&state);
+    }
+  }
+  for (row = 0; row < num_rows; row++) {
+    size_t best = planted_action(X, num_rows, row);
+    for (j = 0; j < num_actions; j++) {
+      rewards[j * num_rows + row] = (j == best ? 1.0 : 0.0) + 0.1 * uniform(&state);
+    }
+  }
+
+  policytree_options options;
+  policytree_default_options(&options);
+  options.num_threads = 2;
+  policytree_tree* tree = NULL;
+  policytree_stats stats;
+  CHECK(policytree_fit(X, rewards, NULL, num_rows, num_features, num_actions, 2, &options, &tree, &stats) == POLICYTREE_OK);
+  CHECK(tree != NULL);
+  CHECK(stats.complete);
+  CHECK(policytree_depth(tree) == 2);
+  CHECK(policytree_num_nodes(tree) == 7);
+
+  double tree_array[28];
+  policytree_tree_array(tree, tree_array);
+  /* the root splits on the first feature (1-indexed) */
+  CHECK(tree_array[0] == 1);
+  CHECK(tree_array[1 * 7 + 0] >= 0.45 && tree_array[1 * 7 + 0] <= 0.55);
+  CHECK(tree_array[2 * 7 + 0] == 2 && tree_array[3 * 7 + 0] == 3);
+
+  CHECK(policytree_predict(tree, X, num_rows, num_features, 1, actions) == POLICYTREE_OK);
+  double reward = 0;
+  size_t num_correct = 0;
+  for (row = 0; row < num_rows; row++) {
+    reward += rewards[actions[row] * num_rows + row];
+    num_correct += actions[row] == planted_action(X, num_rows, row);
+  }
+  CHECK(fabs(reward - policytree_reward(tree)) < 1e-8);
+  CHECK(num_correct >= 490);
+
+  /* unit weights and the defaults (NULL options) fit the same tree */
+  double* weights = malloc(num_rows * sizeof(double));
+  for (row = 0; row < num_rows; row++) {
+    weights[row] = 1;
+  }
+  policytree_tree* weighted = NULL;
+  CHECK(policytree_fit(X, rewards, weights, num_rows, num_features, num_actions, 2, NULL, &weighted, NULL) == POLICYTREE_OK);
+  double weighted_array[28];
+  policytree_tree_array(weighted, weighted_array);
+  CHECK(memcmp(tree_array, weighted_array, sizeof(tree_array)) == 0);
+
+  policytree_free(weighted);
+  policytree_free(tree);
+  free(weights);
+  free(actions);
+  free(rewards);
+  free(X);
+}
+
+static void test_errors(void) {
+  double X[4] = {0, 1, 2, 3};
+  double rewards[8] = {1, 1, 0, 0, 0, 0, 1, 1};
+  size_t actions[4];
+  policytree_tree* tree = NULL;
+  policytree_options options;
+
+  CHECK(policytree_fit(X, rewards, NULL, 4, 1, 2, -1, NULL, &tree, NULL) == POLICYTREE_INVALID_ARGUMENT);
+  CHECK(tree == NULL);
+  CHECK(strstr(policytree_last_error(), "depth") != NULL);
+
+  X[2] = NAN;
+  CHECK(policytree_fit(X, rewards, NULL, 4, 1, 2, 1, NULL, &tree, NULL) == POLICYTREE_INVALID_ARGUMENT);
+  CHECK(strstr(policytree_last_error(), "missing") != NULL);
+  X[2] = 2;
+
+  /* (as in the R package, a single bin and a negative or NaN time limit are rejected) */
+  policytree_default_options(&options);
+  options.max_bins = 1;
+  CHECK(policytree_fit(X, rewards, NULL, 4, 1, 2, 1, &options, &tree, NULL) == POLICYTREE_INVALID_ARGUMENT);
+  CHECK(strstr(policytree_last_error(), "max_bins") != NULL);
+  options.max_bins = 2;
+  options.time_limit = -1;
+  CHECK(policytree_fit(X, rewards, NULL, 4, 1, 2, 1, &options, &tree, NULL) == POLICYTREE_INVALID_ARGUMENT);
+  CHECK(strstr(policytree_last_error(), "time_limit") != NULL);
+  options.time_limit = NAN;
+  CHECK(policytree_fit(X, rewards, NULL, 4, 1, 2, 1, &options, &tree, NULL) == POLICYTREE_INVALID_ARGUMENT);
+  CHECK(tree == NULL);
+
+  CHECK(policytree_fit(X, rewards, NULL, 4, 1, 2, 1, NULL, &tree, NULL) == POLICYTREE_OK);
+  CHECK(strlen(policytree_last_error()) == 0);
+  CHECK(policytree_predict(tree, X, 2, 2, 1, actions) == POLICYTREE_INVALID_ARGUMENT);
+  CHECK(policytree_predict(tree, X, 4, 1, 1, actions) == POLICYTREE_OK);
+  CHECK(actions[0] == 0 && actions[1] == 0 && actions[2] == 1 && actions[3] == 1);
+  policytree_free(tree);
+}
+
+int main(void) {
+  test_fit_and_predict();
+  test_errors();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
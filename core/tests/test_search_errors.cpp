@@ -0,0 +1,77 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "policytree.h"
+#include "tree_search.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// An error on a worker thread of a multi-threaded search is returned (not a crash)
+static void test_worker_error() {
+  size_t num_rows = 200;
+  size_t num_features = 3;
+  size_t num_actions = 3;
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal;
+  std::vector<double> X(num_rows * num_features), rewards(num_rows * num_actions);
+  for (auto& x : X) {
+    x = std::round(10 * normal(rng)) / 10;
+  }
+  for (auto& reward : rewards) {
+    reward = normal(rng);
+  }
+
+  policytree_options options;
+  policytree_default_options(&options);
+  options.num_threads = 2;
+  policytree_tree* tree = nullptr;
+  parallel_search_task_hook = [](size_t task) {
+    if (task == 1) {
+      throw std::bad_alloc();
+    }
+  };
+  CHECK(policytree_fit(X.data(), rewards.data(), nullptr, num_rows, num_features, num_actions, 2,
+                       &options, &tree, nullptr) == POLICYTREE_OUT_OF_MEMORY);
+  parallel_search_task_hook = [](size_t task) {
+    if (task == 1) {
+      throw std::runtime_error("Task failed.");
+    }
+  };
+  CHECK(policytree_fit(X.data(), rewards.data(), nullptr, num_rows, num_features, num_actions, 2,
+                       &options, &tree, nullptr) == POLICYTREE_ERROR);
+  CHECK(std::string(policytree_last_error()) == "Task failed.");
+  parallel_search_task_hook = nullptr;
+  CHECK(tree == nullptr);
+
+  // the same search succeeds once the tasks do
+  CHECK(policytree_fit(X.data(), rewards.data(), nullptr, num_rows, num_features, num_actions, 2,
+                       &options, &tree, nullptr) == POLICYTREE_OK);
+  CHECK(tree != nullptr);
+  policytree_free(tree);
+}
+
+int main() {
+  test_worker_error();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
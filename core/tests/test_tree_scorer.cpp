@@ -0,0 +1,163 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "policytree.h"
+#include "tree_scorer.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// Whether loading `bytes` fails (with a std::runtime_error)
+static bool load_fails(const std::string& bytes) {
+  try {
+    TreeScorer scorer(bytes.data(), bytes.size());
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+static void test_save_and_score() {
+  size_t num_rows = 300;
+  size_t num_features = 3;
+  size_t num_actions = 4;
+  std::mt19937_64 rng(42);
+  std::normal_distribution<double> normal;
+  std::vector<double> X(num_rows * num_features), rewards(num_rows * num_actions);
+  // (rounded, so the depth three search is quick)
+  for (auto& x : X) {
+    x = std::round(10 * normal(rng)) / 10;
+  }
+  for (auto& reward : rewards) {
+    reward = normal(rng);
+  }
+  std::string path = "test_tree_scorer.ptree";
+
+  for (int depth = 0; depth <= 3; depth++) {
+    policytree_tree* tree = nullptr;
+    CHECK(policytree_fit(X.data(), rewards.data(), nullptr, num_rows, num_features, num_actions, depth,
+                         nullptr, &tree, nullptr) == POLICYTREE_OK);
+    const char* feature_names[] = {"a", "b", "c"};
+    CHECK(policytree_save(tree, path.c_str(), feature_names, nullptr) == POLICYTREE_OK);
+
+    TreeScorer scorer(path);
+    CHECK(scorer.num_features() == num_features && scorer.num_actions() == num_actions);
+    CHECK(scorer.get_feature_names()[1] == "b" && scorer.get_action_names()[3] == "4");
+    CHECK(scorer.depth() <= depth);
+    std::vector<size_t> actions(num_rows);
+    CHECK(policytree_predict(tree, X.data(), num_rows, num_features, 1, actions.data()) == POLICYTREE_OK);
+    size_t num_mismatches = 0;
+    for (size_t row = 0; row < num_rows; row++) {
+      // (the row as a contiguous array, and read in place from the column major X)
+      double x[3] = {X[row], X[num_rows + row], X[2 * num_rows + row]};
+      num_mismatches += scorer.predict(x) != actions[row] || scorer.predict(&X[row], num_rows) != actions[row];
+    }
+    CHECK(num_mismatches == 0);
+
+    // one return per leaf
+    std::string code = scorer.to_cpp("score");
+    size_t num_returns = 0;
+    for (size_t pos = code.find("return "); pos != std::string::npos; pos = code.find("return ", pos + 1)) {
+      num_returns++;
+    }
+    CHECK(code.find("inline int score(const double* x)") != std::string::npos);
+    CHECK(2 * num_returns - 1 == scorer.get_nodes().size());
+
+    policytree_free(tree);
+  }
+
+  std::ifstream in(path, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  CHECK(!load_fails(bytes));
+  for (size_t size = 0; size < bytes.size(); size++) {
+    CHECK(load_fails(bytes.substr(0, size)));
+  }
+  std::string wrong_version = bytes;
+  wrong_version[8] = 2;
+  CHECK(load_fails(wrong_version));
+  std::remove(path.c_str());
+}
+
+// Whether `to_cpp(name)` fails (with a std::invalid_argument)
+static bool to_cpp_fails(const TreeScorer& scorer, const std::string& name) {
+  try {
+    scorer.to_cpp(name);
+  } catch (const std::invalid_argument&) {
+    return true;
+  }
+  return false;
+}
+
+static void test_cpp_names() {
+  size_t num_rows = 200;
+  size_t num_features = 3;
+  size_t num_actions = 3;
+  std::mt19937_64 rng(7);
+  std::normal_distribution<double> normal;
+  std::vector<double> X(num_rows * num_features), rewards(num_rows * num_actions);
+  for (auto& x : X) {
+    x = std::round(10 * normal(rng)) / 10;
+  }
+  for (auto& reward : rewards) {
+    reward = normal(rng);
+  }
+  std::string path = "test_tree_scorer_names.ptree";
+  policytree_tree* tree = nullptr;
+  CHECK(policytree_fit(X.data(), rewards.data(), nullptr, num_rows, num_features, num_actions, 2,
+                       nullptr, &tree, nullptr) == POLICYTREE_OK);
+  // names that would break out of a comment written as is (the last ends in the trigraph of a backslash)
+  const char* feature_names[] = {"line\nbreak", "trailing\\", "quote\"?" "?/"};
+  const char* action_names[] = {"carriage\rreturn", "\\", "tab\t"};
+  CHECK(policytree_save(tree, path.c_str(), feature_names, action_names) == POLICYTREE_OK);
+  policytree_free(tree);
+
+  TreeScorer scorer(path);
+  std::string code = scorer.to_cpp("score");
+  // a line per leaf, three per split, and three around them
+  size_t num_lines = std::count(code.begin(), code.end(), '\n');
+  size_t num_splits = 0;
+  for (const ScorerNode& node : scorer.get_nodes()) {
+    num_splits += node.feature >= 0;
+  }
+  CHECK(num_splits > 0);
+  CHECK(num_lines == 3 + 3 * num_splits + (num_splits + 1));
+  CHECK(code.find("\\\n") == std::string::npos && code.find('\r') == std::string::npos);
+  CHECK(code.find("\"line\\x0abreak\"") != std::string::npos && code.find("\"trailing\\\\\"") != std::string::npos &&
+        code.find("\"quote\\\"?" "?/\"") != std::string::npos);
+
+  CHECK(!to_cpp_fails(scorer, "_score2"));
+  CHECK(to_cpp_fails(scorer, ""));
+  CHECK(to_cpp_fails(scorer, "2score"));
+  CHECK(to_cpp_fails(scorer, "score(); int x"));
+  CHECK(to_cpp_fails(scorer, "score\n"));
+  std::remove(path.c_str());
+}
+
+int main() {
+  test_save_and_score();
+  test_cpp_names();
+  if (failures > 0) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
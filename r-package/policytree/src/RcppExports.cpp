@@ -10,37 +10,284 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// validate_data_rcpp
+Rcpp::List validate_data_rcpp(SEXP X, const Rcpp::NumericMatrix& Y, bool count_distinct);
+RcppExport SEXP _policytree_validate_data_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP count_distinctSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< bool >::type count_distinct(count_distinctSEXP);
+    rcpp_result_gen = Rcpp::wrap(validate_data_rcpp(X, Y, count_distinct));
+    return rcpp_result_gen;
+END_RCPP
+}
+// plan_counts_rcpp
+Rcpp::List plan_counts_rcpp(SEXP X, const Rcpp::NumericMatrix& Y, unsigned int max_bins, const Rcpp::IntegerVector& split_steps, int min_node_size);
+RcppExport SEXP _policytree_plan_counts_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP max_binsSEXP, SEXP split_stepsSEXP, SEXP min_node_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type max_bins(max_binsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type split_steps(split_stepsSEXP);
+    Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(plan_counts_rcpp(X, Y, max_bins, split_steps, min_node_size));
+    return rcpp_result_gen;
+END_RCPP
+}
 // tree_search_rcpp
-Rcpp::List tree_search_rcpp(const Rcpp::NumericMatrix& X, const Rcpp::NumericMatrix& Y, int depth, int split_step, int min_node_size);
-RcppExport SEXP _policytree_tree_search_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP) {
+Rcpp::List tree_search_rcpp(SEXP X, const Rcpp::NumericMatrix& Y, SEXP sample_weights, int depth, int split_step, int min_node_size, unsigned int max_bins, bool bound_pruning, unsigned int num_threads, double time_limit, double max_evaluations, double cache_memory, bool collapse_duplicates, bool profile, SEXP progress, double progress_interval);
+RcppExport SEXP _policytree_tree_search_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP sample_weightsSEXP, SEXP depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP, SEXP max_binsSEXP, SEXP bound_pruningSEXP, SEXP num_threadsSEXP, SEXP time_limitSEXP, SEXP max_evaluationsSEXP, SEXP cache_memorySEXP, SEXP collapse_duplicatesSEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP progress_intervalSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sample_weights(sample_weightsSEXP);
+    Rcpp::traits::input_parameter< int >::type depth(depthSEXP);
+    Rcpp::traits::input_parameter< int >::type split_step(split_stepSEXP);
+    Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type max_bins(max_binsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bound_pruning(bound_pruningSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< double >::type time_limit(time_limitSEXP);
+    Rcpp::traits::input_parameter< double >::type max_evaluations(max_evaluationsSEXP);
+    Rcpp::traits::input_parameter< double >::type cache_memory(cache_memorySEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse_duplicates(collapse_duplicatesSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< double >::type progress_interval(progress_intervalSEXP);
+    rcpp_result_gen = Rcpp::wrap(tree_search_rcpp(X, Y, sample_weights, depth, split_step, min_node_size, max_bins, bound_pruning, num_threads, time_limit, max_evaluations, cache_memory, collapse_duplicates, profile, progress, progress_interval));
+    return rcpp_result_gen;
+END_RCPP
+}
+// partial_tree_search_rcpp
+Rcpp::List partial_tree_search_rcpp(SEXP X, const Rcpp::NumericMatrix& Y, SEXP sample_weights, int depth, int split_step, int min_node_size, unsigned int max_bins, bool bound_pruning, unsigned int num_threads, const Rcpp::IntegerVector& root_features, double root_split_begin, double root_split_end);
+RcppExport SEXP _policytree_partial_tree_search_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP sample_weightsSEXP, SEXP depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP, SEXP max_binsSEXP, SEXP bound_pruningSEXP, SEXP num_threadsSEXP, SEXP root_featuresSEXP, SEXP root_split_beginSEXP, SEXP root_split_endSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sample_weights(sample_weightsSEXP);
+    Rcpp::traits::input_parameter< int >::type depth(depthSEXP);
+    Rcpp::traits::input_parameter< int >::type split_step(split_stepSEXP);
+    Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type max_bins(max_binsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bound_pruning(bound_pruningSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::IntegerVector& >::type root_features(root_featuresSEXP);
+    Rcpp::traits::input_parameter< double >::type root_split_begin(root_split_beginSEXP);
+    Rcpp::traits::input_parameter< double >::type root_split_end(root_split_endSEXP);
+    rcpp_result_gen = Rcpp::wrap(partial_tree_search_rcpp(X, Y, sample_weights, depth, split_step, min_node_size, max_bins, bound_pruning, num_threads, root_features, root_split_begin, root_split_end));
+    return rcpp_result_gen;
+END_RCPP
+}
+// hybrid_tree_search_rcpp
+Rcpp::List hybrid_tree_search_rcpp(SEXP X, const Rcpp::NumericMatrix& Y, SEXP sample_weights, int depth, int search_depth, int split_step, int min_node_size, unsigned int num_threads);
+RcppExport SEXP _policytree_hybrid_tree_search_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP sample_weightsSEXP, SEXP depthSEXP, SEXP search_depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP, SEXP num_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
     Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sample_weights(sample_weightsSEXP);
     Rcpp::traits::input_parameter< int >::type depth(depthSEXP);
+    Rcpp::traits::input_parameter< int >::type search_depth(search_depthSEXP);
     Rcpp::traits::input_parameter< int >::type split_step(split_stepSEXP);
     Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
-    rcpp_result_gen = Rcpp::wrap(tree_search_rcpp(X, Y, depth, split_step, min_node_size));
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(hybrid_tree_search_rcpp(X, Y, sample_weights, depth, search_depth, split_step, min_node_size, num_threads));
     return rcpp_result_gen;
 END_RCPP
 }
 // tree_search_rcpp_predict
-Rcpp::NumericMatrix tree_search_rcpp_predict(const Rcpp::NumericMatrix& tree_array, const Rcpp::NumericMatrix& X);
-RcppExport SEXP _policytree_tree_search_rcpp_predict(SEXP tree_arraySEXP, SEXP XSEXP) {
+Rcpp::NumericMatrix tree_search_rcpp_predict(const Rcpp::NumericMatrix& tree_array, const Rcpp::NumericMatrix& X, unsigned int num_threads);
+RcppExport SEXP _policytree_tree_search_rcpp_predict(SEXP tree_arraySEXP, SEXP XSEXP, SEXP num_threadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type tree_array(tree_arraySEXP);
     Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type X(XSEXP);
-    rcpp_result_gen = Rcpp::wrap(tree_search_rcpp_predict(tree_array, X));
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(tree_search_rcpp_predict(tree_array, X, num_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// tree_search_rcpp_evaluate
+Rcpp::List tree_search_rcpp_evaluate(const Rcpp::List& tree_arrays, const Rcpp::NumericMatrix& X, const Rcpp::NumericMatrix& Y, unsigned int num_threads);
+RcppExport SEXP _policytree_tree_search_rcpp_evaluate(SEXP tree_arraysSEXP, SEXP XSEXP, SEXP YSEXP, SEXP num_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::List& >::type tree_arrays(tree_arraysSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(tree_search_rcpp_evaluate(tree_arrays, X, Y, num_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// write_tree_file_rcpp
+void write_tree_file_rcpp(const Rcpp::NumericMatrix& tree_array, const std::vector<std::string>& columns, const std::vector<std::string>& action_names, const std::string& file);
+RcppExport SEXP _policytree_write_tree_file_rcpp(SEXP tree_arraySEXP, SEXP columnsSEXP, SEXP action_namesSEXP, SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type tree_array(tree_arraySEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type action_names(action_namesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    write_tree_file_rcpp(tree_array, columns, action_names, file);
+    return R_NilValue;
+END_RCPP
+}
+// tree_cpp_code_rcpp
+std::string tree_cpp_code_rcpp(const Rcpp::NumericMatrix& tree_array, const std::vector<std::string>& columns, const std::vector<std::string>& action_names, const std::string& function_name);
+RcppExport SEXP _policytree_tree_cpp_code_rcpp(SEXP tree_arraySEXP, SEXP columnsSEXP, SEXP action_namesSEXP, SEXP function_nameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type tree_array(tree_arraySEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type action_names(action_namesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type function_name(function_nameSEXP);
+    rcpp_result_gen = Rcpp::wrap(tree_cpp_code_rcpp(tree_array, columns, action_names, function_name));
+    return rcpp_result_gen;
+END_RCPP
+}
+// read_tree_file_rcpp
+Rcpp::List read_tree_file_rcpp(const std::string& file);
+RcppExport SEXP _policytree_read_tree_file_rcpp(SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    rcpp_result_gen = Rcpp::wrap(read_tree_file_rcpp(file));
+    return rcpp_result_gen;
+END_RCPP
+}
+// write_data_file_rcpp
+void write_data_file_rcpp(SEXP X, const Rcpp::NumericMatrix& Y, const std::vector<std::string>& columns, const std::vector<std::string>& action_names, const std::string& file);
+RcppExport SEXP _policytree_write_data_file_rcpp(SEXP XSEXP, SEXP YSEXP, SEXP columnsSEXP, SEXP action_namesSEXP, SEXP fileSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type columns(columnsSEXP);
+    Rcpp::traits::input_parameter< const std::vector<std::string>& >::type action_names(action_namesSEXP);
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    write_data_file_rcpp(X, Y, columns, action_names, file);
+    return R_NilValue;
+END_RCPP
+}
+// data_file_summary_rcpp
+Rcpp::List data_file_summary_rcpp(const std::string& file, bool count_distinct);
+RcppExport SEXP _policytree_data_file_summary_rcpp(SEXP fileSEXP, SEXP count_distinctSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< bool >::type count_distinct(count_distinctSEXP);
+    rcpp_result_gen = Rcpp::wrap(data_file_summary_rcpp(file, count_distinct));
+    return rcpp_result_gen;
+END_RCPP
+}
+// data_file_tree_search_rcpp
+Rcpp::List data_file_tree_search_rcpp(const std::string& file, SEXP sample_weights, int depth, int split_step, int min_node_size, unsigned int max_bins, bool bound_pruning, unsigned int num_threads, double time_limit, double max_evaluations, double cache_memory, bool collapse_duplicates, bool profile, SEXP progress, double progress_interval);
+RcppExport SEXP _policytree_data_file_tree_search_rcpp(SEXP fileSEXP, SEXP sample_weightsSEXP, SEXP depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP, SEXP max_binsSEXP, SEXP bound_pruningSEXP, SEXP num_threadsSEXP, SEXP time_limitSEXP, SEXP max_evaluationsSEXP, SEXP cache_memorySEXP, SEXP collapse_duplicatesSEXP, SEXP profileSEXP, SEXP progressSEXP, SEXP progress_intervalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const std::string& >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sample_weights(sample_weightsSEXP);
+    Rcpp::traits::input_parameter< int >::type depth(depthSEXP);
+    Rcpp::traits::input_parameter< int >::type split_step(split_stepSEXP);
+    Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type max_bins(max_binsSEXP);
+    Rcpp::traits::input_parameter< bool >::type bound_pruning(bound_pruningSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< double >::type time_limit(time_limitSEXP);
+    Rcpp::traits::input_parameter< double >::type max_evaluations(max_evaluationsSEXP);
+    Rcpp::traits::input_parameter< double >::type cache_memory(cache_memorySEXP);
+    Rcpp::traits::input_parameter< bool >::type collapse_duplicates(collapse_duplicatesSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< double >::type progress_interval(progress_intervalSEXP);
+    rcpp_result_gen = Rcpp::wrap(data_file_tree_search_rcpp(file, sample_weights, depth, split_step, min_node_size, max_bins, bound_pruning, num_threads, time_limit, max_evaluations, cache_memory, collapse_duplicates, profile, progress, progress_interval));
+    return rcpp_result_gen;
+END_RCPP
+}
+// create_search_index_rcpp
+SEXP create_search_index_rcpp(SEXP X, unsigned int max_bins);
+RcppExport SEXP _policytree_create_search_index_rcpp(SEXP XSEXP, SEXP max_binsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type X(XSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type max_bins(max_binsSEXP);
+    rcpp_result_gen = Rcpp::wrap(create_search_index_rcpp(X, max_bins));
+    return rcpp_result_gen;
+END_RCPP
+}
+// search_index_tree_search_rcpp
+Rcpp::List search_index_tree_search_rcpp(SEXP index, const Rcpp::NumericMatrix& Y, int depth, int split_step, int min_node_size, bool bound_pruning, unsigned int num_threads, double incumbent, SEXP progress, double progress_interval);
+RcppExport SEXP _policytree_search_index_tree_search_rcpp(SEXP indexSEXP, SEXP YSEXP, SEXP depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP, SEXP bound_pruningSEXP, SEXP num_threadsSEXP, SEXP incumbentSEXP, SEXP progressSEXP, SEXP progress_intervalSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type index(indexSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::NumericMatrix& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< int >::type depth(depthSEXP);
+    Rcpp::traits::input_parameter< int >::type split_step(split_stepSEXP);
+    Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type bound_pruning(bound_pruningSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    Rcpp::traits::input_parameter< double >::type incumbent(incumbentSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    Rcpp::traits::input_parameter< double >::type progress_interval(progress_intervalSEXP);
+    rcpp_result_gen = Rcpp::wrap(search_index_tree_search_rcpp(index, Y, depth, split_step, min_node_size, bound_pruning, num_threads, incumbent, progress, progress_interval));
+    return rcpp_result_gen;
+END_RCPP
+}
+// search_index_batch_rcpp
+Rcpp::List search_index_batch_rcpp(SEXP index, const Rcpp::List& Y_list, const Rcpp::List& weight_list, int depth, int split_step, int min_node_size, bool bound_pruning, unsigned int num_threads);
+RcppExport SEXP _policytree_search_index_batch_rcpp(SEXP indexSEXP, SEXP Y_listSEXP, SEXP weight_listSEXP, SEXP depthSEXP, SEXP split_stepSEXP, SEXP min_node_sizeSEXP, SEXP bound_pruningSEXP, SEXP num_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type index(indexSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::List& >::type Y_list(Y_listSEXP);
+    Rcpp::traits::input_parameter< const Rcpp::List& >::type weight_list(weight_listSEXP);
+    Rcpp::traits::input_parameter< int >::type depth(depthSEXP);
+    Rcpp::traits::input_parameter< int >::type split_step(split_stepSEXP);
+    Rcpp::traits::input_parameter< int >::type min_node_size(min_node_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type bound_pruning(bound_pruningSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type num_threads(num_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(search_index_batch_rcpp(index, Y_list, weight_list, depth, split_step, min_node_size, bound_pruning, num_threads));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_policytree_tree_search_rcpp", (DL_FUNC) &_policytree_tree_search_rcpp, 5},
-    {"_policytree_tree_search_rcpp_predict", (DL_FUNC) &_policytree_tree_search_rcpp_predict, 2},
+    {"_policytree_validate_data_rcpp", (DL_FUNC) &_policytree_validate_data_rcpp, 3},
+    {"_policytree_plan_counts_rcpp", (DL_FUNC) &_policytree_plan_counts_rcpp, 5},
+    {"_policytree_tree_search_rcpp", (DL_FUNC) &_policytree_tree_search_rcpp, 16},
+    {"_policytree_partial_tree_search_rcpp", (DL_FUNC) &_policytree_partial_tree_search_rcpp, 12},
+    {"_policytree_hybrid_tree_search_rcpp", (DL_FUNC) &_policytree_hybrid_tree_search_rcpp, 8},
+    {"_policytree_tree_search_rcpp_predict", (DL_FUNC) &_policytree_tree_search_rcpp_predict, 3},
+    {"_policytree_tree_search_rcpp_evaluate", (DL_FUNC) &_policytree_tree_search_rcpp_evaluate, 4},
+    {"_policytree_write_tree_file_rcpp", (DL_FUNC) &_policytree_write_tree_file_rcpp, 4},
+    {"_policytree_tree_cpp_code_rcpp", (DL_FUNC) &_policytree_tree_cpp_code_rcpp, 4},
+    {"_policytree_read_tree_file_rcpp", (DL_FUNC) &_policytree_read_tree_file_rcpp, 1},
+    {"_policytree_write_data_file_rcpp", (DL_FUNC) &_policytree_write_data_file_rcpp, 5},
+    {"_policytree_data_file_summary_rcpp", (DL_FUNC) &_policytree_data_file_summary_rcpp, 2},
+    {"_policytree_data_file_tree_search_rcpp", (DL_FUNC) &_policytree_data_file_tree_search_rcpp, 15},
+    {"_policytree_create_search_index_rcpp", (DL_FUNC) &_policytree_create_search_index_rcpp, 2},
+    {"_policytree_search_index_tree_search_rcpp", (DL_FUNC) &_policytree_search_index_tree_search_rcpp, 10},
+    {"_policytree_search_index_batch_rcpp", (DL_FUNC) &_policytree_search_index_batch_rcpp, 8},
     {NULL, NULL, 0}
 };
 
@@ -1,44 +1,19 @@
 #include <queue>
 #include <Rcpp.h>
 
+#include "data_file.h"
+#include "tree_predict.h"
+#include "tree_scorer.h"
 #include "tree_search.h"
 
 /**
-  * Find the depth `depth` tree that maximizes the sum of rewards.
-  *
-  * @param X The features
-  * @param Y The rewards
-  * @param depth The tree depth (0-indexed). An integer greater than or equal to zero.
-  * @param split_step The number of possible splits to consider when performing tree search.
-  * (an integer greater than or equal to one.)
-  * @param min_node_size An integer indicating the smallest terminal node size permitted.
-  * @return The best tree stored in an adjacency list (same format as `grf`).
+  * Convert a tree to the list returned to R (see `tree_search_rcpp`).
   *
-  * The returned list's first entry:
-  * a list of of lists (nodes), where each each leaf node
-  * have the entries: ($is_leaf = TRUE, $action = column_id_of_best_action)
-  * and each non-leaf node have entries:
-  * ($is_leaf = FALSE, split_variable = colum_id_of_best_split,
-  *  $split_value = best_split, $left_child = list_index_of_left_child,
-  *  $right_child = list_index_of_right_child).
-  * The returned list's second entry:
-  * The same tree represented as an array for faster lookups. We return the
-  * first representation for seamless integration with GRF, which uses the same
-  * data structure.
+  * @param root The tree.
+  * @param depth The (largest possible) tree depth.
+  * @param stats The search counters.
   */
-// [[Rcpp::export]]
-Rcpp::List tree_search_rcpp(const Rcpp::NumericMatrix& X,
-                            const Rcpp::NumericMatrix& Y,
-                            int depth,
-                            int split_step,
-                            int min_node_size) {
-  size_t num_rows = X.rows();
-  size_t num_cols_x = X.cols();
-  size_t num_cols_y = Y.cols();
-  const Data* data = new Data(X.begin(), Y.begin(), num_rows, num_cols_x, num_cols_y);
-
-  std::unique_ptr<Node> root = tree_search(depth, split_step, min_node_size, data);
-
+Rcpp::List tree_to_list(std::unique_ptr<Node> root, int depth, const SearchStats& stats) {
   // We store the tree as the same list data structure (`nodes`) as GRF for seamless integration with
   // the plot and print methods. We also store the tree as an array (`tree_array`) for faster lookups.
   // This will make a difference for a very large amount of lookups, like n = 1 000 000.
@@ -80,8 +55,378 @@ Rcpp::List tree_search_rcpp(const Rcpp::NumericMatrix& X,
   Rcpp::List result;
   result.push_back(nodes);
   result.push_back(tree_array);
+  Rcpp::List search_stats = Rcpp::List::create(Rcpp::Named("num.subtrees") = static_cast<double>(stats.num_subtrees),
+                                                Rcpp::Named("num.pruned") = static_cast<double>(stats.num_pruned),
+                                                Rcpp::Named("cache.hits") = static_cast<double>(stats.num_cache_hits),
+                                                Rcpp::Named("cache.misses") = static_cast<double>(stats.num_cache_misses),
+                                                Rcpp::Named("complete") = stats.complete,
+                                                Rcpp::Named("fraction.searched") = stats.fraction_searched);
+  if (!stats.levels.empty()) {
+    // one row per level of the recursion, from the leaves' parents (level 1) up to the root
+    size_t num_levels = stats.levels.size() - 1;
+    Rcpp::IntegerVector level(num_levels);
+    Rcpp::NumericVector num_level_nodes(num_levels), num_pruned(num_levels), num_evaluated(num_levels),
+      num_ties(num_levels), num_too_small(num_levels), num_stepped_over(num_levels),
+      num_partitioned(num_levels), seconds(num_levels);
+    for (size_t l = 0; l < num_levels; l++) {
+      const LevelStats& level_stats = stats.levels[l + 1];
+      level[l] = static_cast<int>(l + 1);
+      num_level_nodes[l] = static_cast<double>(level_stats.num_nodes);
+      num_pruned[l] = static_cast<double>(level_stats.num_pruned);
+      num_evaluated[l] = static_cast<double>(level_stats.num_evaluated);
+      num_ties[l] = static_cast<double>(level_stats.num_ties);
+      num_too_small[l] = static_cast<double>(level_stats.num_too_small);
+      num_stepped_over[l] = static_cast<double>(level_stats.num_stepped_over);
+      num_partitioned[l] = static_cast<double>(level_stats.num_partitioned);
+      seconds[l] = level_stats.seconds;
+    }
+    search_stats.push_back(Rcpp::DataFrame::create(Rcpp::Named("level") = level,
+                                                   Rcpp::Named("num.nodes") = num_level_nodes,
+                                                   Rcpp::Named("num.pruned") = num_pruned,
+                                                   Rcpp::Named("num.evaluated") = num_evaluated,
+                                                   Rcpp::Named("num.ties") = num_ties,
+                                                   Rcpp::Named("num.too.small") = num_too_small,
+                                                   Rcpp::Named("num.stepped.over") = num_stepped_over,
+                                                   Rcpp::Named("num.partitioned") = num_partitioned,
+                                                   Rcpp::Named("seconds") = seconds), "levels");
+    search_stats.push_back(Rcpp::NumericVector(stats.feature_seconds.begin(), stats.feature_seconds.end()),
+                           "feature.seconds");
+  }
+  result.push_back(search_stats);
+
+  return result;
+}
+
+/**
+  * Check for user interrupts during tree search, and report its progress.
+  *
+  * @param progress NULL, or an R function that is called about every `progress_interval` seconds with
+  * a list describing the progress of the search. The search is cancelled if it returns FALSE.
+  * @param progress_interval The number of seconds between calls to `progress`.
+  * @param options The search options to set the callback on.
+  */
+void set_progress(SEXP progress, double progress_interval, SearchOptions& options) {
+  double last_report = 0;
+  options.progress_interval = 0.2; // the interval between interrupt checks
+  options.progress = [=](const SearchProgress& state) mutable {
+    Rcpp::checkUserInterrupt();
+    if (Rf_isNull(progress) || state.elapsed - last_report < progress_interval) {
+      return true;
+    }
+    last_report = state.elapsed;
+    double eta = NA_REAL;
+    if (state.num_evaluated > 0) {
+      eta = state.elapsed * (static_cast<double>(state.num_candidates) - state.num_evaluated) / state.num_evaluated;
+    }
+    Rcpp::Function callback(progress);
+    SEXP result = callback(Rcpp::List::create(
+      Rcpp::Named("num.evaluated") = static_cast<double>(state.num_evaluated),
+      Rcpp::Named("num.candidates") = static_cast<double>(state.num_candidates),
+      Rcpp::Named("elapsed") = state.elapsed,
+      Rcpp::Named("best.reward") = state.best_reward,
+      Rcpp::Named("eta") = eta));
+    return !(Rf_isLogical(result) && Rf_length(result) == 1 && LOGICAL(result)[0] == FALSE);
+  };
+}
+
+/**
+  * The sample weights passed to a search (NULL for unit weights, otherwise a double vector with
+  * one non-negative weight per row, where samples with weight zero are left out).
+  */
+const double* sample_weights_or_null(SEXP sample_weights) {
+  return Rf_isNull(sample_weights) ? nullptr : REAL(sample_weights);
+}
+
+/**
+  * Convert a data summary to the list returned to R (see `validate_data_rcpp`).
+  */
+Rcpp::List summary_to_list(const DataSummary& summary, bool count_distinct) {
+  Rcpp::RObject cardinality = R_NilValue;
+  if (count_distinct && !summary.missing_x) {
+    cardinality = Rcpp::wrap(std::vector<double>(summary.cardinality.begin(), summary.cardinality.end()));
+  }
+
+  return Rcpp::List::create(Rcpp::Named("missing.X") = summary.missing_x,
+                            Rcpp::Named("missing.Gamma") = summary.missing_y,
+                            Rcpp::Named("cardinality") = cardinality);
+}
+
+/**
+  * Check the input to tree search, without copying it.
+  *
+  * @param X The features (a numeric or integer matrix)
+  * @param Y The rewards
+  * @param count_distinct Whether to count the distinct values of each feature.
+  * @return A list with whether X and Y contain missing values, and the number of distinct values
+  * of each feature (NULL if not counted, or if X has missing values).
+  */
+// [[Rcpp::export]]
+Rcpp::List validate_data_rcpp(SEXP X,
+                              const Rcpp::NumericMatrix& Y,
+                              bool count_distinct) {
+  DataSummary summary;
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    IntegerData data(X_int.begin(), Y.begin(), X_int.rows(), X_int.cols(), Y.cols());
+    summary = summarize_data(&data, count_distinct);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    Data data(X_double.begin(), Y.begin(), X_double.rows(), X_double.cols(), Y.cols());
+    summary = summarize_data(&data, count_distinct);
+  }
+
+  return summary_to_list(summary, count_distinct);
+}
+
+/**
+  * Count the split positions of tree search, for `plan_policy_tree`.
+  *
+  * @param X The features (a numeric or integer matrix, without missing values)
+  * @param Y The rewards
+  * @param max_bins If greater than zero, the maximum number of (quantile) bins of each feature.
+  * @param split_steps The values of `split_step` to count the root split positions of.
+  * @param min_node_size The smallest terminal node size permitted.
+  * @return A list with the number of samples of each distinct value (or bin) of each feature
+  * (`value.counts`, in increasing order of the values), and the number of root split positions of each
+  * feature (rows) for each split step (columns).
+  */
+// [[Rcpp::export]]
+Rcpp::List plan_counts_rcpp(SEXP X,
+                            const Rcpp::NumericMatrix& Y,
+                            unsigned int max_bins,
+                            const Rcpp::IntegerVector& split_steps,
+                            int min_node_size) {
+  std::vector<std::vector<size_t>> value_counts;
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    IntegerData data(X_int.begin(), Y.begin(), X_int.rows(), X_int.cols(), Y.cols());
+    value_counts = feature_value_counts(&data, max_bins);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    Data data(X_double.begin(), Y.begin(), X_double.rows(), X_double.cols(), Y.cols());
+    value_counts = feature_value_counts(&data, max_bins);
+  }
+
+  Rcpp::List value_counts_list(value_counts.size());
+  Rcpp::NumericMatrix root_candidates(value_counts.size(), split_steps.size());
+  for (size_t j = 0; j < value_counts.size(); j++) {
+    value_counts_list[j] = Rcpp::wrap(std::vector<double>(value_counts[j].begin(), value_counts[j].end()));
+    for (R_xlen_t k = 0; k < split_steps.size(); k++) {
+      root_candidates(j, k) = count_split_candidates(value_counts[j], split_steps[k], min_node_size);
+    }
+  }
+
+  return Rcpp::List::create(Rcpp::Named("value.counts") = value_counts_list,
+                            Rcpp::Named("root.candidates") = root_candidates);
+}
+
+/**
+  * Find the depth `depth` tree that maximizes the sum of rewards.
+  *
+  * @param X The features (a numeric or integer matrix, which is searched without conversion)
+  * @param Y The rewards
+  * @param sample_weights NULL, or the sample weights (see `sample_weights_or_null`).
+  * @param depth The tree depth (0-indexed). An integer greater than or equal to zero.
+  * @param split_step The number of possible splits to consider when performing tree search.
+  * (an integer greater than or equal to one.)
+  * @param min_node_size An integer indicating the smallest terminal node size permitted.
+  * @param max_bins If greater than zero, the maximum number of (quantile) bins to consider splitting
+  * each feature at.
+  * @param bound_pruning Whether to skip subtrees whose reward bound can not beat the best tree found
+  * so far (the result is identical).
+  * @param num_threads Number of threads used in tree search (0 uses all available cores).
+  * @param time_limit If greater than zero, the seconds after which the search stops and returns the best
+  * tree found so far.
+  * @param max_evaluations If greater than zero, the number of root split positions after which the search
+  * stops and returns the best tree found so far.
+  * @param cache_memory The bytes to cache depth one subtrees in (only used if depth >= 3, 0 disables the cache).
+  * @param collapse_duplicates Whether to search the distinct rows of X (each with the summed rewards of its samples).
+  * @param profile Whether to count the split positions evaluated and skipped, and time, each level of the search.
+  * @param progress NULL, or a function called with the search progress (see `set_progress`).
+  * @param progress_interval The number of seconds between calls to `progress`.
+  * @return The best tree stored in an adjacency list (same format as `grf`).
+  *
+  * The returned list's first entry:
+  * a list of of lists (nodes), where each each leaf node
+  * have the entries: ($is_leaf = TRUE, $action = column_id_of_best_action)
+  * and each non-leaf node have entries:
+  * ($is_leaf = FALSE, split_variable = colum_id_of_best_split,
+  *  $split_value = best_split, $left_child = list_index_of_left_child,
+  *  $right_child = list_index_of_right_child).
+  * The returned list's second entry:
+  * The same tree represented as an array for faster lookups. We return the
+  * first representation for seamless integration with GRF, which uses the same
+  * data structure.
+  * The returned list's third entry:
+  * The search counters (the number of subtrees considered and pruned, the depth one subtrees found in
+  * and added to the cache, whether the search ran to completion, and the share of root splits searched),
+  * with `profile` also the counters of each level (`levels`) and the seconds spent on each root feature.
+  */
+// [[Rcpp::export]]
+Rcpp::List tree_search_rcpp(SEXP X,
+                            const Rcpp::NumericMatrix& Y,
+                            SEXP sample_weights,
+                            int depth,
+                            int split_step,
+                            int min_node_size,
+                            unsigned int max_bins,
+                            bool bound_pruning,
+                            unsigned int num_threads,
+                            double time_limit,
+                            double max_evaluations,
+                            double cache_memory,
+                            bool collapse_duplicates,
+                            bool profile,
+                            SEXP progress,
+                            double progress_interval) {
+  SearchOptions options;
+  options.split_step = split_step;
+  options.min_node_size = min_node_size;
+  options.max_bins = max_bins;
+  options.bound_pruning = bound_pruning;
+  options.num_threads = num_threads;
+  options.time_limit = time_limit;
+  options.max_evaluations = static_cast<size_t>(max_evaluations);
+  options.cache_memory = static_cast<size_t>(cache_memory);
+  options.collapse_duplicates = collapse_duplicates;
+  options.profile = profile;
+  set_progress(progress, progress_interval, options);
+  SearchStats stats;
+
+  std::unique_ptr<Node> root;
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    IntegerData data(X_int.begin(), Y.begin(), X_int.rows(), X_int.cols(), Y.cols());
+    data.set_weights(sample_weights_or_null(sample_weights));
+    root = tree_search(depth, options, &data, &stats);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    Data data(X_double.begin(), Y.begin(), X_double.rows(), X_double.cols(), Y.cols());
+    data.set_weights(sample_weights_or_null(sample_weights));
+    root = tree_search(depth, options, &data, &stats);
+  }
+
+  Rcpp::List result = tree_to_list(std::move(root), depth, stats);
+  return result;
+}
+
+/**
+  * Find the depth `depth` tree that maximizes the sum of rewards among the trees whose root split is in a
+  * slice of the root split candidates (see `RootSlice`), so the search can be divided between processes.
+  *
+  * @param X The features (a numeric or integer matrix)
+  * @param Y The rewards
+  * @param sample_weights NULL, or the sample weights (see `sample_weights_or_null`).
+  * @param depth The tree depth.
+  * @param split_step The number of possible splits to consider when performing tree search.
+  * @param min_node_size An integer indicating the smallest terminal node size permitted.
+  * @param max_bins If greater than zero, the maximum number of (quantile) bins to split each feature at.
+  * @param bound_pruning Whether to skip subtrees whose reward bound can not beat the best tree found so far.
+  * @param num_threads Number of threads used in tree search (0 uses all available cores).
+  * @param root_features The (0-indexed) root features of the slice (all features if empty).
+  * @param root_split_begin The first root split position of the slice (0-indexed).
+  * @param root_split_end One past the last root split position of the slice.
+  * @return The tree, in the same format as `tree_search_rcpp`, with a fourth entry describing its
+  * root split (see `RootSplit`, with 1-indexed features and positions).
+  */
+// [[Rcpp::export]]
+Rcpp::List partial_tree_search_rcpp(SEXP X,
+                                    const Rcpp::NumericMatrix& Y,
+                                    SEXP sample_weights,
+                                    int depth,
+                                    int split_step,
+                                    int min_node_size,
+                                    unsigned int max_bins,
+                                    bool bound_pruning,
+                                    unsigned int num_threads,
+                                    const Rcpp::IntegerVector& root_features,
+                                    double root_split_begin,
+                                    double root_split_end) {
+  SearchOptions options;
+  options.split_step = split_step;
+  options.min_node_size = min_node_size;
+  options.max_bins = max_bins;
+  options.bound_pruning = bound_pruning;
+  options.num_threads = num_threads;
+  set_progress(R_NilValue, 0, options);
+  RootSlice slice;
+  slice.features.assign(root_features.begin(), root_features.end());
+  slice.begin = static_cast<size_t>(root_split_begin);
+  slice.end = static_cast<size_t>(root_split_end);
+  RootSplit root;
+  SearchStats stats;
+
+  std::unique_ptr<Node> tree;
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    IntegerData data(X_int.begin(), Y.begin(), X_int.rows(), X_int.cols(), Y.cols());
+    data.set_weights(sample_weights_or_null(sample_weights));
+    tree = partial_tree_search(depth, options, slice, &data, &root, &stats);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    Data data(X_double.begin(), Y.begin(), X_double.rows(), X_double.cols(), Y.cols());
+    data.set_weights(sample_weights_or_null(sample_weights));
+    tree = partial_tree_search(depth, options, slice, &data, &root, &stats);
+  }
+
+  Rcpp::List result = tree_to_list(std::move(tree), depth, stats);
+  result.push_back(Rcpp::List::create(Rcpp::Named("found") = root.found,
+                                      Rcpp::Named("reward") = root.reward,
+                                      Rcpp::Named("feature") = static_cast<double>(root.feature + 1),
+                                      Rcpp::Named("position") = static_cast<double>(root.position + 1),
+                                      Rcpp::Named("num.candidates") = static_cast<double>(root.num_candidates)));
+  return result;
+}
+
+/**
+  * Find a depth `depth` tree with hybrid tree search.
+  *
+  * Each node is split by the root split of the best depth `search_depth` tree on its samples, until
+  * `depth` is reached (where the entire depth `search_depth` tree is attached) or the best tree is a leaf.
+  * The features are compressed and sorted once, and the samples of each node are passed on as
+  * partitions of these.
+  *
+  * @param X The features (a numeric or integer matrix)
+  * @param Y The rewards
+  * @param sample_weights NULL, or the sample weights (see `sample_weights_or_null`).
+  * @param depth The tree depth. An integer greater than `search_depth`.
+  * @param search_depth The depth to look ahead when splitting a node.
+  * @param split_step The number of possible splits to consider when performing tree search.
+  * (an integer greater than or equal to one.)
+  * @param min_node_size An integer indicating the smallest terminal node size permitted.
+  * @param num_threads Number of threads used in tree search (0 uses all available cores).
+  * @return The tree, in the same format as `tree_search_rcpp`.
+  */
+// [[Rcpp::export]]
+Rcpp::List hybrid_tree_search_rcpp(SEXP X,
+                                   const Rcpp::NumericMatrix& Y,
+                                   SEXP sample_weights,
+                                   int depth,
+                                   int search_depth,
+                                   int split_step,
+                                   int min_node_size,
+                                   unsigned int num_threads) {
+  SearchOptions options;
+  options.split_step = split_step;
+  options.min_node_size = min_node_size;
+  options.num_threads = num_threads;
+  set_progress(R_NilValue, 0, options);
+  SearchStats stats;
+
+  std::unique_ptr<Node> root;
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    IntegerData data(X_int.begin(), Y.begin(), X_int.rows(), X_int.cols(), Y.cols());
+    data.set_weights(sample_weights_or_null(sample_weights));
+    root = hybrid_tree_search(depth, search_depth, options, &data, &stats);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    Data data(X_double.begin(), Y.begin(), X_double.rows(), X_double.cols(), Y.cols());
+    data.set_weights(sample_weights_or_null(sample_weights));
+    root = hybrid_tree_search(depth, search_depth, options, &data, &stats);
+  }
+  Rcpp::List result = tree_to_list(std::move(root), depth, stats);
 
-  delete data;
   return result;
 }
 
@@ -90,34 +435,349 @@ Rcpp::List tree_search_rcpp(const Rcpp::NumericMatrix& X,
   *
   * @param tree_array The tree.
   * @param X The query samples.
+  * @param num_threads Number of threads used in prediction (0 uses all available cores).
   * @return A vector of action IDs.
   *
   */
 // [[Rcpp::export]]
 Rcpp::NumericMatrix tree_search_rcpp_predict(const Rcpp::NumericMatrix& tree_array,
-                                             const Rcpp::NumericMatrix& X) {
+                                             const Rcpp::NumericMatrix& X,
+                                             unsigned int num_threads) {
   size_t num_samples = X.rows();
   Rcpp::NumericMatrix result(num_samples, 2);
-  for (size_t sample = 0; sample < num_samples; sample++) {
-    size_t node = 0;
-    while (true) {
-      bool is_leaf = tree_array(node, 0) == -1;
-      if (is_leaf) {
-        size_t action = tree_array(node, 1);
-        result(sample, 0) = action;
-        result(sample, 1) = node;
-        break;
-      }
-      size_t split_var = tree_array(node, 0) - 1; // Offset by 1 for C++ indexing
-      double split_value = tree_array(node, 1);
-      double value = X(sample, split_var);
-      if (value <= split_value) {
-        node = tree_array(node, 2) - 1;
-      } else {
-        node = tree_array(node, 3) - 1;
+  PredictTree tree(tree_array.begin(), tree_array.rows());
+  predict_tree(tree, X.begin(), num_samples, num_threads, result.begin(), result.begin() + num_samples);
+
+  return result;
+}
+
+/**
+  * Evaluate trees on query samples with rewards in one pass (see `evaluate_trees`).
+  *
+  * @param tree_arrays A list of trees (tree arrays as in `tree_search_rcpp_predict`).
+  * @param X The query samples.
+  * @param Y The rewards of the query samples (with at least as many columns as the trees' actions).
+  * @param num_threads Number of threads used (0 uses all available cores).
+  * @return For each tree, a matrix with a row per row of its tree array: the number of samples in the
+  * node, and the sum and the sum of squares of the rewards of the node's action (zero for splits).
+  */
+// [[Rcpp::export]]
+Rcpp::List tree_search_rcpp_evaluate(const Rcpp::List& tree_arrays,
+                                     const Rcpp::NumericMatrix& X,
+                                     const Rcpp::NumericMatrix& Y,
+                                     unsigned int num_threads) {
+  std::vector<PredictTree> trees;
+  for (R_xlen_t t = 0; t < tree_arrays.size(); t++) {
+    Rcpp::NumericMatrix tree_array(tree_arrays[t]);
+    trees.push_back(PredictTree(tree_array.begin(), tree_array.rows()));
+  }
+  std::vector<std::vector<double>> rewards = evaluate_trees(trees, X.begin(), Y.begin(), X.rows(), num_threads);
+
+  Rcpp::List result(trees.size());
+  for (size_t t = 0; t < trees.size(); t++) {
+    size_t num_nodes = trees[t].num_nodes();
+    Rcpp::NumericMatrix node_rewards(num_nodes, 3);
+    for (size_t node = 0; node < num_nodes; node++) {
+      for (size_t k = 0; k < 3; k++) {
+        node_rewards(node, k) = rewards[t][3 * node + k];
       }
     }
+    result[t] = node_rewards;
   }
 
   return result;
 }
+
+/**
+  * Write a tree to a tree file (see `TreeScorer`).
+  *
+  * @param tree_array The tree.
+  * @param columns The names of the features.
+  * @param action_names The names of the actions.
+  * @param file The path of the file.
+  */
+// [[Rcpp::export]]
+void write_tree_file_rcpp(const Rcpp::NumericMatrix& tree_array,
+                          const std::vector<std::string>& columns,
+                          const std::vector<std::string>& action_names,
+                          const std::string& file) {
+  write_tree_file(file, tree_array.begin(), tree_array.rows(), columns, action_names);
+}
+
+/**
+  * The C++ source of a function that predicts the (0-indexed) action of a row (see `TreeScorer::to_cpp`).
+  *
+  * @param tree_array The tree.
+  * @param columns The names of the features.
+  * @param action_names The names of the actions.
+  * @param function_name The name of the function.
+  */
+// [[Rcpp::export]]
+std::string tree_cpp_code_rcpp(const Rcpp::NumericMatrix& tree_array,
+                               const std::vector<std::string>& columns,
+                               const std::vector<std::string>& action_names,
+                               const std::string& function_name) {
+  std::string bytes = serialize_tree(tree_array.begin(), tree_array.rows(), columns, action_names);
+  TreeScorer scorer(bytes.data(), bytes.size());
+  return scorer.to_cpp(function_name);
+}
+
+/**
+  * Read a tree file.
+  *
+  * @param file The path of the file.
+  * @return A list with the tree array (one row per node of the file, see `tree_to_list`), the depth
+  * of the tree, and the names of the features and actions.
+  */
+// [[Rcpp::export]]
+Rcpp::List read_tree_file_rcpp(const std::string& file) {
+  TreeScorer scorer(file);
+  const std::vector<ScorerNode>& nodes = scorer.get_nodes();
+  size_t num_nodes = nodes.size();
+  Rcpp::NumericMatrix tree_array(num_nodes, 4);
+  for (size_t j = 0; j < num_nodes; j++) {
+    if (nodes[j].feature < 0) {
+      tree_array(j, 0) = -1;
+      tree_array(j, 1) = nodes[j].next + 1;
+    } else {
+      tree_array(j, 0) = nodes[j].feature + 1;
+      tree_array(j, 1) = nodes[j].value;
+      tree_array(j, 2) = nodes[j].next + 1;
+      tree_array(j, 3) = nodes[j].next + 2;
+    }
+  }
+
+  return Rcpp::List::create(Rcpp::Named("tree.array") = tree_array,
+                            Rcpp::Named("depth") = scorer.depth(),
+                            Rcpp::Named("columns") = scorer.get_feature_names(),
+                            Rcpp::Named("action.names") = scorer.get_action_names());
+}
+
+/**
+  * Write training data to a file that tree search can memory map (see `DataFile`).
+  *
+  * @param X The features (a numeric or integer matrix)
+  * @param Y The rewards
+  * @param columns The names of the features.
+  * @param action_names The names of the actions.
+  * @param file The path of the file.
+  */
+// [[Rcpp::export]]
+void write_data_file_rcpp(SEXP X,
+                          const Rcpp::NumericMatrix& Y,
+                          const std::vector<std::string>& columns,
+                          const std::vector<std::string>& action_names,
+                          const std::string& file) {
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    write_data_file(file, X_int.begin(), Y.begin(), X_int.rows(), columns, action_names);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    write_data_file(file, X_double.begin(), Y.begin(), X_double.rows(), columns, action_names);
+  }
+}
+
+/**
+  * Check the training data in a data file, without loading it.
+  *
+  * @param file The path of the file.
+  * @param count_distinct Whether to count the distinct values of each feature.
+  * @return The list returned by `validate_data_rcpp`, with the number of rows and the names of the
+  * features and actions.
+  */
+// [[Rcpp::export]]
+Rcpp::List data_file_summary_rcpp(const std::string& file,
+                                  bool count_distinct) {
+  DataFile data_file(file);
+  DataSummary summary;
+  if (data_file.integer_features()) {
+    IntegerData data = data_file.get_integer_data();
+    summary = summarize_data(&data, count_distinct);
+  } else {
+    Data data = data_file.get_data();
+    summary = summarize_data(&data, count_distinct);
+  }
+
+  Rcpp::List result = summary_to_list(summary, count_distinct);
+  result.push_back(static_cast<double>(data_file.num_rows), "num.rows");
+  result.push_back(data_file.get_feature_names(), "columns");
+  result.push_back(data_file.get_reward_names(), "action.names");
+  return result;
+}
+
+/**
+  * Find the depth `depth` tree that maximizes the sum of rewards, on data read from a data file.
+  *
+  * The file is memory mapped, and is read in place. The parameters (`file` in place of `X` and `Y`)
+  * and the result are those of `tree_search_rcpp`.
+  */
+// [[Rcpp::export]]
+Rcpp::List data_file_tree_search_rcpp(const std::string& file,
+                                      SEXP sample_weights,
+                                      int depth,
+                                      int split_step,
+                                      int min_node_size,
+                                      unsigned int max_bins,
+                                      bool bound_pruning,
+                                      unsigned int num_threads,
+                                      double time_limit,
+                                      double max_evaluations,
+                                      double cache_memory,
+                                      bool collapse_duplicates,
+                                      bool profile,
+                                      SEXP progress,
+                                      double progress_interval) {
+  SearchOptions options;
+  options.split_step = split_step;
+  options.min_node_size = min_node_size;
+  options.max_bins = max_bins;
+  options.bound_pruning = bound_pruning;
+  options.num_threads = num_threads;
+  options.time_limit = time_limit;
+  options.max_evaluations = static_cast<size_t>(max_evaluations);
+  options.cache_memory = static_cast<size_t>(cache_memory);
+  options.collapse_duplicates = collapse_duplicates;
+  options.profile = profile;
+  set_progress(progress, progress_interval, options);
+  SearchStats stats;
+
+  DataFile data_file(file);
+  std::unique_ptr<Node> root;
+  if (data_file.integer_features()) {
+    IntegerData data = data_file.get_integer_data();
+    data.set_weights(sample_weights_or_null(sample_weights));
+    root = tree_search(depth, options, &data, &stats);
+  } else {
+    Data data = data_file.get_data();
+    data.set_weights(sample_weights_or_null(sample_weights));
+    root = tree_search(depth, options, &data, &stats);
+  }
+
+  Rcpp::List result = tree_to_list(std::move(root), depth, stats);
+  return result;
+}
+
+/**
+  * Create a search index of the features in `X`, to search trees on different rewards without
+  * compressing and sorting the features again (see `SearchIndex`).
+  *
+  * @param X The features (a numeric or integer matrix)
+  * @param max_bins If greater than zero, the maximum number of (quantile) bins to split each feature at.
+  * @return An external pointer to the index.
+  */
+// [[Rcpp::export]]
+SEXP create_search_index_rcpp(SEXP X,
+                              unsigned int max_bins) {
+  std::unique_ptr<SearchIndex> index;
+  if (TYPEOF(X) == INTSXP) {
+    Rcpp::IntegerMatrix X_int(X);
+    IntegerData data(X_int.begin(), nullptr, X_int.rows(), X_int.cols(), 0);
+    index = create_search_index(&data, max_bins);
+  } else {
+    Rcpp::NumericMatrix X_double(X);
+    Data data(X_double.begin(), nullptr, X_double.rows(), X_double.cols(), 0);
+    index = create_search_index(&data, max_bins);
+  }
+
+  return Rcpp::XPtr<SearchIndex>(index.release(), true);
+}
+
+/**
+  * Find the depth `depth` tree that maximizes the sum of rewards, on the features of a search index.
+  *
+  * @param index An external pointer created by `create_search_index_rcpp`.
+  * @param Y The rewards (with a row for each row of the features the index was created from)
+  * @param incumbent The reward of a known tree (e.g. the tree found on the previous rewards), which
+  * the search starts from when pruning (-Inf for none).
+  * @return The tree, in the same format as `tree_search_rcpp`. The other parameters are those of
+  * `tree_search_rcpp`.
+  */
+// [[Rcpp::export]]
+Rcpp::List search_index_tree_search_rcpp(SEXP index,
+                                         const Rcpp::NumericMatrix& Y,
+                                         int depth,
+                                         int split_step,
+                                         int min_node_size,
+                                         bool bound_pruning,
+                                         unsigned int num_threads,
+                                         double incumbent,
+                                         SEXP progress,
+                                         double progress_interval) {
+  Rcpp::XPtr<SearchIndex> search_index(index);
+  if (search_index.get() == nullptr) {
+    throw std::runtime_error("The search index is no longer valid (it can not be saved and restored).");
+  }
+  if (static_cast<size_t>(Y.rows()) != search_index->num_samples()) {
+    throw std::runtime_error("The rewards do not have a row for each sample of the search index.");
+  }
+  SearchOptions options;
+  options.split_step = split_step;
+  options.min_node_size = min_node_size;
+  options.bound_pruning = bound_pruning;
+  options.num_threads = num_threads;
+  options.incumbent = incumbent;
+  set_progress(progress, progress_interval, options);
+  SearchStats stats;
+
+  std::unique_ptr<Node> root = search_index->search(depth, options, RewardSet(Y.begin(), Y.cols(), nullptr), &stats);
+
+  Rcpp::List result = tree_to_list(std::move(root), depth, stats);
+  return result;
+}
+
+/**
+  * Find the depth `depth` tree that maximizes the sum of rewards for each in a batch of rewards (and
+  * sample weights), on the features of a search index. The searches are divided between the threads.
+  *
+  * @param index An external pointer created by `create_search_index_rcpp`.
+  * @param Y_list The rewards of each search (double matrices with a row for each sample of the index)
+  * @param weight_list The sample weights of each search (double vectors, or NULL for unit weights).
+  * Samples with weight zero are left out of the search.
+  * @return A list with the tree of each search, in the same format as `tree_search_rcpp`. The other
+  * parameters are those of `tree_search_rcpp`.
+  */
+// [[Rcpp::export]]
+Rcpp::List search_index_batch_rcpp(SEXP index,
+                                   const Rcpp::List& Y_list,
+                                   const Rcpp::List& weight_list,
+                                   int depth,
+                                   int split_step,
+                                   int min_node_size,
+                                   bool bound_pruning,
+                                   unsigned int num_threads) {
+  Rcpp::XPtr<SearchIndex> search_index(index);
+  if (search_index.get() == nullptr) {
+    throw std::runtime_error("The search index is no longer valid (it can not be saved and restored).");
+  }
+  // (the elements are double, so the vectors below are views of them, which outlive the loop)
+  std::vector<RewardSet> reward_sets;
+  for (R_xlen_t b = 0; b < Y_list.size(); b++) {
+    SEXP Y_b = Y_list[b];
+    Rcpp::NumericMatrix Y(Y_b);
+    if (static_cast<size_t>(Y.rows()) != search_index->num_samples()) {
+      throw std::runtime_error("The rewards do not have a row for each sample of the search index.");
+    }
+    const double* weights = nullptr;
+    SEXP weight_b = weight_list[b];
+    if (!Rf_isNull(weight_b)) {
+      Rcpp::NumericVector weight(weight_b);
+      weights = weight.begin();
+    }
+    reward_sets.push_back(RewardSet(Y.begin(), Y.cols(), weights));
+  }
+  SearchOptions options;
+  options.split_step = split_step;
+  options.min_node_size = min_node_size;
+  options.bound_pruning = bound_pruning;
+  options.num_threads = num_threads;
+  set_progress(R_NilValue, 0, options);
+  std::vector<SearchStats> stats;
+
+  std::vector<std::unique_ptr<Node>> trees = search_index->search_batch(depth, options, reward_sets, &stats);
+
+  Rcpp::List result(trees.size());
+  for (size_t b = 0; b < trees.size(); b++) {
+    result[b] = tree_to_list(std::move(trees[b]), depth, stats[b]);
+  }
+  return result;
+}
@@ -0,0 +1,171 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "data_file.h"
+
+namespace {
+
+const char MAGIC[8] = {'P', 'T', 'R', 'E', 'E', 'D', 'A', 'T'};
+const uint32_t VERSION = 1;
+
+struct DataFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t feature_type;
+  uint64_t num_rows;
+  uint64_t num_cols_x;
+  uint64_t num_cols_y;
+};
+
+// The number of bytes of a `rows` by `cols` block of `size` byte elements, padded to a multiple of 8
+// (throws if it exceeds `max_size`, checked without overflow)
+size_t block_size(uint64_t rows, uint64_t cols, size_t size, size_t max_size) {
+  if (cols > 0 && rows > max_size / size / cols) {
+    throw std::runtime_error("The data file is truncated.");
+  }
+  return (rows * cols * size + 7) / 8 * 8;
+}
+
+// Read `count` names starting at `*pos`, with `end` the end of the file
+std::vector<std::string> read_names(const char** pos, const char* end, size_t count) {
+  std::vector<std::string> names(count);
+  for (size_t j = 0; j < count; j++) {
+    uint32_t length;
+    if (static_cast<size_t>(end - *pos) < sizeof(length)) {
+      throw std::runtime_error("The data file is truncated.");
+    }
+    std::memcpy(&length, *pos, sizeof(length));
+    *pos += sizeof(length);
+    if (static_cast<size_t>(end - *pos) < length) {
+      throw std::runtime_error("The data file is truncated.");
+    }
+    names[j].assign(*pos, length);
+    *pos += length;
+  }
+
+  return names;
+}
+
+void write_names(std::ofstream& out, const std::vector<std::string>& names) {
+  for (const auto& name : names) {
+    uint32_t length = static_cast<uint32_t>(name.size());
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(name.data(), length);
+  }
+}
+
+uint32_t feature_type_of(const double*) {
+  return DataFile::DOUBLE_FEATURES;
+}
+
+uint32_t feature_type_of(const int32_t*) {
+  return DataFile::INTEGER_FEATURES;
+}
+
+} // namespace
+
+
+DataFile::DataFile(const std::string& path) {
+  try {
+    file = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+    region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+  } catch (const boost::interprocess::interprocess_exception& e) {
+    throw std::runtime_error("Could not open the data file " + path + ": " + e.what());
+  }
+
+  const char* begin = static_cast<const char*>(region.get_address());
+  const char* end = begin + region.get_size();
+  DataFileHeader header;
+  if (region.get_size() < sizeof(header)) {
+    throw std::runtime_error("The file " + path + " is not a policytree data file.");
+  }
+  std::memcpy(&header, begin, sizeof(header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error("The file " + path + " is not a policytree data file.");
+  }
+  if (header.version != VERSION) {
+    throw std::runtime_error("Unsupported data file version (or byte order) in " + path + ".");
+  }
+  if (header.feature_type != DOUBLE_FEATURES && header.feature_type != INTEGER_FEATURES) {
+    throw std::runtime_error("Unsupported feature type in the data file " + path + ".");
+  }
+
+  size_t max_size = region.get_size() - sizeof(header);
+  size_t size_x = block_size(header.num_rows, header.num_cols_x,
+                             header.feature_type == INTEGER_FEATURES ? sizeof(int32_t) : sizeof(double),
+                             max_size);
+  size_t size_y = block_size(header.num_rows, header.num_cols_y, sizeof(double), max_size);
+  // (names take at least 4 bytes per column, which bounds the number of columns)
+  if (size_x + size_y > max_size || header.num_cols_x + header.num_cols_y > max_size / sizeof(uint32_t)) {
+    throw std::runtime_error("The data file is truncated.");
+  }
+  feature_type = header.feature_type;
+  num_rows = header.num_rows;
+  num_cols_x = header.num_cols_x;
+  num_cols_y = header.num_cols_y;
+
+  data_x = begin + sizeof(header);
+  data_y = data_x + size_x;
+  const char* pos = data_y + size_y;
+  feature_names = read_names(&pos, end, num_cols_x);
+  reward_names = read_names(&pos, end, num_cols_y);
+}
+
+
+Data DataFile::get_data() const {
+  return Data(reinterpret_cast<const double*>(data_x), reinterpret_cast<const double*>(data_y),
+              num_rows, num_cols_x, num_cols_y);
+}
+
+
+IntegerData DataFile::get_integer_data() const {
+  return IntegerData(reinterpret_cast<const int32_t*>(data_x), reinterpret_cast<const double*>(data_y),
+                     num_rows, num_cols_x, num_cols_y);
+}
+
+
+template <typename FeatureType>
+void write_data_file(const std::string& path,
+                     const FeatureType* x,
+                     const double* y,
+                     size_t num_rows,
+                     const std::vector<std::string>& feature_names,
+                     const std::vector<std::string>& reward_names) {
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Could not open the file " + path + " for writing.");
+  }
+
+  DataFileHeader header;
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.feature_type = feature_type_of(x);
+  header.num_rows = num_rows;
+  header.num_cols_x = feature_names.size();
+  header.num_cols_y = reward_names.size();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  size_t size_x = num_rows * feature_names.size() * sizeof(FeatureType);
+  out.write(reinterpret_cast<const char*>(x), size_x);
+  const char padding[8] = {0};
+  out.write(padding, (8 - size_x % 8) % 8);
+  out.write(reinterpret_cast<const char*>(y), num_rows * reward_names.size() * sizeof(double));
+  write_names(out, feature_names);
+  write_names(out, reward_names);
+
+  out.close();
+  if (!out) {
+    throw std::runtime_error("Could not write the file " + path + ".");
+  }
+}
+
+
+template void write_data_file<double>(const std::string&, const double*, const double*, size_t,
+                                      const std::vector<std::string>&, const std::vector<std::string>&);
+template void write_data_file<int32_t>(const std::string&, const int32_t*, const double*, size_t,
+                                       const std::vector<std::string>&, const std::vector<std::string>&);
@@ -0,0 +1,83 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#ifndef DATA_FILE_H
+#define DATA_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "tree_search.h"
+
+/**
+ * Training data stored in a flat binary file, which is memory mapped (read-only) instead of loaded.
+ *
+ * File layout (native byte order, every block starts at a multiple of 8 bytes):
+ *
+ *  header | "PTREEDAT" | uint32 version (1) | uint32 feature type (0: float64, 1: int32) |
+ *         | uint64 num_rows | uint64 num_cols_x | uint64 num_cols_y |
+ *  X      | num_rows * num_cols_x features, column major (zero padded to a multiple of 8 bytes)
+ *  Y      | num_rows * num_cols_y float64 rewards, column major
+ *  names  | for each column of X, then of Y: uint32 length | the name's characters
+ *
+ * The features and rewards are read in place through `get_data` / `get_integer_data`, so pages
+ * are only read from disk as the search touches them and concurrent processes mapping the same
+ * file share one page cached copy. (The search itself stores the features as ranks and the
+ * rewards row major, see `tree_search`.)
+ */
+class DataFile {
+public:
+  // Map the file at `path`, throws a std::runtime_error if it is not a valid data file
+  explicit DataFile(const std::string& path);
+
+  // Whether the features are stored as 32-bit integers (otherwise as doubles)
+  bool integer_features() const {
+    return feature_type == INTEGER_FEATURES;
+  }
+
+  // The data, if the features are doubles
+  Data get_data() const;
+
+  // The data, if the features are integers
+  IntegerData get_integer_data() const;
+
+  const std::vector<std::string>& get_feature_names() const {
+    return feature_names;
+  }
+
+  const std::vector<std::string>& get_reward_names() const {
+    return reward_names;
+  }
+
+  size_t num_rows;
+
+  static const uint32_t DOUBLE_FEATURES = 0;
+  static const uint32_t INTEGER_FEATURES = 1;
+
+private:
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+  uint32_t feature_type;
+  size_t num_cols_x;
+  size_t num_cols_y;
+  const char* data_x;
+  const char* data_y;
+  std::vector<std::string> feature_names;
+  std::vector<std::string> reward_names;
+};
+
+// Write column major features `x` and rewards `y` (with column names) to a data file (see `DataFile`)
+template <typename FeatureType>
+void write_data_file(const std::string& path,
+                     const FeatureType* x,
+                     const double* y,
+                     size_t num_rows,
+                     const std::vector<std::string>& feature_names,
+                     const std::vector<std::string>& reward_names);
+
+#endif // DATA_FILE_H
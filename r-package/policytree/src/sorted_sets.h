@@ -0,0 +1,235 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#ifndef SORTED_SETS_H
+#define SORTED_SETS_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * The samples in a node, sorted along every feature.
+ *
+ * A view of `num_features` contiguous arrays of `size()` (32-bit) sample indices, where array j
+ * holds the node's samples sorted along feature j (by value, then by sample index). The indices
+ * are stored in memory owned by the caller (the search workspace), which is allocated once.
+ *
+ * The sets are never updated one sample at a time: a split of a node is materialized by a
+ * stable partition of each of the parent's arrays (see `partition_sorted_sets`), which
+ * preserves the sort order without any comparisons.
+ */
+class SortedSets {
+public:
+  SortedSets(uint32_t* index, size_t num_points) :
+  num_points(num_points), index(index) {
+  }
+
+  // The sample indices sorted along feature j.
+  const uint32_t* begin(size_t j) const {
+    return index + j * num_points;
+  }
+
+  const uint32_t* end(size_t j) const {
+    return begin(j) + num_points;
+  }
+
+  uint32_t* begin(size_t j) {
+    return index + j * num_points;
+  }
+
+  size_t size() const {
+    return num_points;
+  }
+
+private:
+  size_t num_points;
+  uint32_t* index;
+};
+
+
+/**
+ * The features coordinate compressed to dense ranks, computed once before tree search.
+ *
+ * rank(i, j) is the number of distinct values of feature j smaller than sample i's value, so tied
+ * samples share a rank and the ranks of feature j are 0, ..., num_values(j) - 1. The search only
+ * compares values along a feature and checks where they change, so it runs entirely on ranks;
+ * `get_value` maps a rank back to the original value when a split is stored in the tree.
+ * (With binning, a rank is a bin of consecutive values, represented by the largest value in it.)
+ *
+ * The ranks are stored as `RankType`, an unsigned integer type wide enough for the number of
+ * distinct values of every feature: the search reads a rank for every sample it sweeps past, so
+ * narrower ranks take proportionally less memory bandwidth.
+ */
+template <typename RankType>
+class SampleRanks {
+public:
+  SampleRanks() : num_rows(0), num_cols(0) {
+  }
+
+  SampleRanks(size_t num_rows, size_t num_cols) :
+  num_rows(num_rows), num_cols(num_cols), ranks(num_rows * num_cols), values(num_cols) {
+  }
+
+  // Convert ranks to a (narrower) type, which must hold num_values(j) - 1 for every feature j.
+  template <typename OtherRankType>
+  explicit SampleRanks(const SampleRanks<OtherRankType>& other) :
+  num_rows(other.num_samples()), num_cols(other.num_features()),
+  ranks(other.ranks.begin(), other.ranks.end()), values(other.values) {
+  }
+
+  uint32_t get(size_t row, size_t col) const {
+    return ranks[col * num_rows + row];
+  }
+
+  void set(size_t row, size_t col, uint32_t rank) {
+    ranks[col * num_rows + row] = rank;
+  }
+
+  // The original value of the samples with rank `rank` along feature `col`.
+  double get_value(size_t col, uint32_t rank) const {
+    return values[col][rank];
+  }
+
+  // Append the next distinct value (in increasing order) of feature `col`.
+  void add_value(size_t col, double value) {
+    values[col].push_back(value);
+  }
+
+  size_t num_values(size_t col) const {
+    return values[col].size();
+  }
+
+  size_t num_features() const {
+    return num_cols;
+  }
+
+  size_t num_samples() const {
+    return num_rows;
+  }
+
+private:
+  template <typename OtherRankType>
+  friend class SampleRanks;
+
+  size_t num_rows;
+  size_t num_cols;
+  std::vector<RankType> ranks;
+  std::vector<std::vector<double>> values;
+};
+
+
+/**
+ * The rewards stored row-major, with the rewards of all actions of a sample in one contiguous row.
+ *
+ * The search accumulates rewards one sample at a time in sorted order, so this turns the
+ * scattered reads of a column-major matrix (one per action) into a single contiguous read.
+ *
+ * Also stores each sample's largest reward: the reward of any tree on a set of samples is at most
+ * the sum of these over the set, which bounds the subtrees in branch-and-bound search.
+ *
+ * A sample may stand for several identical samples (see `collapse_duplicates`): its rewards are then
+ * their sums, and its count (1 unless counts are set) is the number of samples it stands for, which
+ * is what `min_node_size` and `split_step` count.
+ */
+class RewardRows {
+public:
+  RewardRows(size_t num_rows, size_t num_cols) :
+  num_cols(num_cols), rewards(num_rows * num_cols), max_rewards(num_rows), slack(0.0), exact(false) {
+  }
+
+  // Compute the reward bounds, called once all the rewards are set (with a rounding error slack of at
+  // least `min_slack`).
+  void compute_bounds(double min_slack = 0) {
+    double abs_sum = 0;
+    for (size_t i = 0; i < max_rewards.size(); i++) {
+      const double* row = get(i);
+      max_rewards[i] = *std::max_element(row, row + num_cols);
+      double max_abs = 0;
+      for (size_t d = 0; d < num_cols; d++) {
+        max_abs = std::max(max_abs, std::fabs(row[d]));
+      }
+      abs_sum += max_abs;
+    }
+    // A (generous) bound on the floating point error of any sum of rewards the search computes
+    slack = std::max(min_slack, 8 * (max_rewards.size() + 1) * DBL_EPSILON * abs_sum);
+
+    // Every sum the search computes is a sum of the rewards of a set of samples (one action each), so
+    // at most `abs_sum` in absolute value. If the rewards are all multiples of 2^exponent and `abs_sum`
+    // is below 2^(53 + exponent), every partial sum is a multiple of 2^exponent that fits in a double's
+    // mantissa, so no sum is rounded (whatever order it is taken in)
+    int exponent = std::numeric_limits<int>::max();
+    for (size_t i = 0; i < rewards.size(); i++) {
+      double reward = rewards[i];
+      if (reward == 0 || (exponent != std::numeric_limits<int>::max() &&
+                          std::ldexp(reward, -exponent) == std::floor(std::ldexp(reward, -exponent)))) {
+        continue;
+      }
+      // the exponent of the lowest set bit of `reward`
+      int reward_exponent;
+      double mantissa = std::fabs(std::frexp(reward, &reward_exponent));
+      int digits = std::numeric_limits<double>::digits;
+      reward_exponent -= digits;
+      for (double m = std::ldexp(mantissa, digits); std::fmod(m, 2.0) == 0; m /= 2) {
+        reward_exponent++;
+      }
+      exponent = std::min(exponent, reward_exponent);
+    }
+    exact = exponent == std::numeric_limits<int>::max() ||
+      abs_sum < std::ldexp(1.0, std::numeric_limits<double>::digits + exponent);
+  }
+
+  // Set the number of samples each sample stands for
+  void set_counts(std::vector<uint32_t> sample_counts) {
+    counts = std::move(sample_counts);
+  }
+
+  // The number of samples each sample stands for, or null if every sample stands for itself
+  const uint32_t* get_counts() const {
+    return counts.empty() ? nullptr : counts.data();
+  }
+
+  // The rewards of all actions of sample `row`.
+  const double* get(size_t row) const {
+    return rewards.data() + row * num_cols;
+  }
+
+  double* get(size_t row) {
+    return rewards.data() + row * num_cols;
+  }
+
+  size_t num_rewards() const {
+    return num_cols;
+  }
+
+  // The largest reward of sample `row`
+  double max_reward(size_t row) const {
+    return max_rewards[row];
+  }
+
+  // A bound is only used to prune a subtree if it is smaller than the reward to beat by more than this
+  double bound_slack() const {
+    return slack;
+  }
+
+  // Whether every sum of rewards the search computes is exact, so is the same whatever order its
+  // terms are added in (e.g. if the rewards are integers)
+  bool exact_sums() const {
+    return exact;
+  }
+
+private:
+  size_t num_cols;
+  std::vector<double> rewards;
+  std::vector<double> max_rewards;
+  std::vector<uint32_t> counts;
+  double slack;
+  bool exact;
+};
+
+#endif // SORTED_SETS_H
@@ -0,0 +1,170 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#ifndef SUBPROBLEM_CACHE_H
+#define SUBPROBLEM_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A least recently used cache of the results of tree search subproblems, keyed by their samples.
+ *
+ * The samples of a node are the samples that fall in a box, the intersection of the split conditions
+ * on the path to it. The tightest such box, the smallest and largest rank along each feature (the first
+ * and last entries of the node's sorted sets), contains the same samples, so it identifies the node
+ * regardless of the order of the splits that led to it: the node reached by splitting on x1 and then x2
+ * has the same key as the one reached by splitting on x2 and then x1.
+ *
+ * A key is `key_size()` 32-bit integers. The cache holds as many entries as fit in a memory budget:
+ * they are stored in slots that are allocated as they are first filled, kept in a doubly linked list
+ * in order of use (the least recently used entry is evicted when an entry is added to a full cache),
+ * and found through a chained hash table over the slots (allocated up front).
+ */
+template <typename Value>
+class SubproblemCache {
+public:
+  SubproblemCache() : key_length(0), capacity(0), num_entries(0) {
+  }
+
+  // Allocate a cache of `key_length` integer keys that takes up at most about `memory` bytes
+  void reset(size_t key_length, size_t memory) {
+    this->key_length = key_length;
+    size_t entry_size = key_length * sizeof(uint32_t) + sizeof(Value) + sizeof(size_t) + 5 * sizeof(uint32_t);
+    capacity = std::min(memory / entry_size, static_cast<size_t>(UINT32_MAX - 1));
+    num_entries = 0;
+    size_t num_buckets = 1;
+    while (num_buckets < capacity) {
+      num_buckets *= 2;
+    }
+    buckets.assign(capacity > 0 ? num_buckets : 0, NONE);
+    keys.clear();
+    values.clear();
+    hashes.clear();
+    chain.clear();
+    older.clear();
+    newer.clear();
+    oldest = NONE;
+    newest = NONE;
+    key_buffer.assign(key_length, 0);
+  }
+
+  bool enabled() const {
+    return capacity > 0;
+  }
+
+  size_t key_size() const {
+    return key_length;
+  }
+
+  // A buffer to write the key of a lookup to
+  uint32_t* key() {
+    return key_buffer.data();
+  }
+
+  // The value stored under the key in `key()` (null if there is none), which becomes the most recently used
+  const Value* find() {
+    size_t hash = hash_key(key_buffer.data());
+    for (uint32_t slot = buckets[hash & (buckets.size() - 1)]; slot != NONE; slot = chain[slot]) {
+      if (hashes[slot] == hash && std::equal(key_buffer.begin(), key_buffer.end(), keys.begin() + slot * key_length)) {
+        unlink(slot);
+        push_newest(slot);
+        return &values[slot];
+      }
+    }
+    return nullptr;
+  }
+
+  // Store `value` under the key in `key()` (which must not be in the cache), evicting the least recently used entry if full
+  void insert(const Value& value) {
+    uint32_t slot;
+    if (num_entries < capacity) {
+      slot = static_cast<uint32_t>(num_entries++);
+      keys.resize(num_entries * key_length);
+      values.resize(num_entries);
+      hashes.resize(num_entries);
+      chain.resize(num_entries);
+      older.resize(num_entries);
+      newer.resize(num_entries);
+    } else {
+      slot = oldest;
+      unlink(slot);
+      remove_from_bucket(slot);
+    }
+    size_t hash = hash_key(key_buffer.data());
+    std::copy(key_buffer.begin(), key_buffer.end(), keys.begin() + slot * key_length);
+    values[slot] = value;
+    hashes[slot] = hash;
+    size_t bucket = hash & (buckets.size() - 1);
+    chain[slot] = buckets[bucket];
+    buckets[bucket] = slot;
+    push_newest(slot);
+  }
+
+private:
+  static const uint32_t NONE = UINT32_MAX;
+
+  // FNV-1a over the key
+  size_t hash_key(const uint32_t* key) const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < key_length; i++) {
+      hash = (hash ^ key[i]) * 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash ^ (hash >> 32));
+  }
+
+  void unlink(uint32_t slot) {
+    if (older[slot] != NONE) {
+      newer[older[slot]] = newer[slot];
+    } else {
+      oldest = newer[slot];
+    }
+    if (newer[slot] != NONE) {
+      older[newer[slot]] = older[slot];
+    } else {
+      newest = older[slot];
+    }
+  }
+
+  void push_newest(uint32_t slot) {
+    older[slot] = newest;
+    newer[slot] = NONE;
+    if (newest != NONE) {
+      newer[newest] = slot;
+    } else {
+      oldest = slot;
+    }
+    newest = slot;
+  }
+
+  void remove_from_bucket(uint32_t slot) {
+    uint32_t* link = &buckets[hashes[slot] & (buckets.size() - 1)];
+    while (*link != slot) {
+      link = &chain[*link];
+    }
+    *link = chain[slot];
+  }
+
+  size_t key_length;
+  size_t capacity;
+  size_t num_entries;
+  std::vector<uint32_t> buckets;
+  std::vector<uint32_t> keys;
+  std::vector<Value> values;
+  std::vector<size_t> hashes;
+  // the next slot in the same bucket
+  std::vector<uint32_t> chain;
+  // the neighbours of each slot in order of use
+  std::vector<uint32_t> older;
+  std::vector<uint32_t> newer;
+  uint32_t oldest;
+  uint32_t newest;
+  std::vector<uint32_t> key_buffer;
+};
+
+template <typename Value>
+const uint32_t SubproblemCache<Value>::NONE;
+
+#endif // SUBPROBLEM_CACHE_H
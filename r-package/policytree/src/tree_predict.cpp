@@ -0,0 +1,202 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#include <algorithm>
+#include <thread>
+
+#include "tree_predict.h"
+
+// The number of samples moved down the tree together, one level at a time
+const size_t BLOCK_SIZE = 256;
+// Don't start a thread for fewer samples than this
+const size_t MIN_SAMPLES_PER_THREAD = 16384;
+// The most contiguous slices of samples `evaluate_trees` sums separately (and then in order)
+const size_t MAX_EVALUATION_SLICES = 64;
+
+
+PredictTree::PredictTree(const double* tree_array, size_t num_nodes) :
+  split_var(num_nodes, 0), split_value(num_nodes, 0.0),
+  left_child(num_nodes, 0), right_child(num_nodes, 0),
+  action(num_nodes, 0.0), max_depth(0) {
+  const double* column_var = tree_array;
+  const double* column_value = tree_array + num_nodes;
+  const double* column_left = tree_array + 2 * num_nodes;
+  const double* column_right = tree_array + 3 * num_nodes;
+
+  // Walk the nodes reachable from the root, recording the depth of every node
+  std::vector<int> node_depth(num_nodes, 0);
+  std::vector<int> frontier(1, 0);
+  while (!frontier.empty()) {
+    int node = frontier.back();
+    frontier.pop_back();
+    max_depth = std::max(max_depth, node_depth[node]);
+    if (column_var[node] == -1) {
+      split_var[node] = 0;
+      left_child[node] = node;
+      right_child[node] = node;
+      action[node] = column_value[node];
+    } else {
+      split_var[node] = static_cast<size_t>(column_var[node]) - 1; // Offset by 1 for C++ indexing
+      split_value[node] = column_value[node];
+      left_child[node] = static_cast<int>(column_left[node]) - 1;
+      right_child[node] = static_cast<int>(column_right[node]) - 1;
+      node_depth[left_child[node]] = node_depth[node] + 1;
+      node_depth[right_child[node]] = node_depth[node] + 1;
+      frontier.push_back(left_child[node]);
+      frontier.push_back(right_child[node]);
+    }
+  }
+}
+
+
+void PredictTree::find_leaves(const double* X, size_t num_rows, size_t block, size_t block_size, int* node) const {
+  std::fill(node, node + block_size, 0);
+  // Each level is one branch free pass over the block: the samples read consecutive rows of the
+  // (few) split columns, and leaves point back at themselves.
+  for (int level = 0; level < max_depth; level++) {
+    for (size_t i = 0; i < block_size; i++) {
+      int n = node[i];
+      double value = X[split_var[n] * num_rows + block + i];
+      node[i] = value <= split_value[n] ? left_child[n] : right_child[n];
+    }
+  }
+}
+
+
+void PredictTree::predict(const double* X,
+                          size_t num_rows,
+                          size_t begin,
+                          size_t end,
+                          double* actions,
+                          double* nodes) const {
+  int node[BLOCK_SIZE];
+  for (size_t block = begin; block < end; block += BLOCK_SIZE) {
+    size_t block_size = std::min(BLOCK_SIZE, end - block);
+    find_leaves(X, num_rows, block, block_size, node);
+    for (size_t i = 0; i < block_size; i++) {
+      actions[block + i] = action[node[i]];
+      nodes[block + i] = node[i];
+    }
+  }
+}
+
+
+void PredictTree::evaluate(const double* X,
+                           const double* Y,
+                           size_t num_rows,
+                           size_t begin,
+                           size_t end,
+                           double* rewards) const {
+  int node[BLOCK_SIZE];
+  for (size_t block = begin; block < end; block += BLOCK_SIZE) {
+    size_t block_size = std::min(BLOCK_SIZE, end - block);
+    find_leaves(X, num_rows, block, block_size, node);
+    // (the reward of the leaf's action, read in place instead of gathered into a vector of rewards)
+    for (size_t i = 0; i < block_size; i++) {
+      int n = node[i];
+      double reward = Y[(static_cast<size_t>(action[n]) - 1) * num_rows + block + i];
+      double* leaf = rewards + 3 * n;
+      leaf[0] += 1;
+      leaf[1] += reward;
+      leaf[2] += reward * reward;
+    }
+  }
+}
+
+
+void predict_tree(const PredictTree& tree,
+                  const double* X,
+                  size_t num_rows,
+                  size_t num_threads,
+                  double* actions,
+                  double* nodes) {
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  num_threads = std::max(std::min(num_threads, num_rows / MIN_SAMPLES_PER_THREAD), static_cast<size_t>(1));
+  if (num_threads == 1) {
+    tree.predict(X, num_rows, 0, num_rows, actions, nodes);
+    return;
+  }
+
+  // Contiguous chunks of whole blocks
+  size_t num_blocks = (num_rows + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  size_t blocks_per_thread = (num_blocks + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+  for (size_t i = 0; i < num_threads; i++) {
+    size_t begin = std::min(i * blocks_per_thread * BLOCK_SIZE, num_rows);
+    size_t end = std::min(begin + blocks_per_thread * BLOCK_SIZE, num_rows);
+    threads.push_back(std::thread(&PredictTree::predict, &tree, X, num_rows, begin, end, actions, nodes));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+
+std::vector<std::vector<double>> evaluate_trees(const std::vector<PredictTree>& trees,
+                                                const double* X,
+                                                const double* Y,
+                                                size_t num_rows,
+                                                size_t num_threads) {
+  // The per node sums of each tree are stored one after the other (from offsets[t])
+  std::vector<size_t> offsets(trees.size() + 1, 0);
+  for (size_t t = 0; t < trees.size(); t++) {
+    offsets[t + 1] = offsets[t] + 3 * trees[t].num_nodes();
+  }
+  size_t size = offsets.back();
+
+  // Contiguous slices of whole blocks, whose number depends only on the number of samples, each summed
+  // separately by one thread and then added up in order. A slice is swept once: each block of samples
+  // is evaluated with every tree while it is in cache.
+  size_t num_blocks = (num_rows + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  size_t num_slices = std::max(std::min(MAX_EVALUATION_SLICES, num_rows / MIN_SAMPLES_PER_THREAD), static_cast<size_t>(1));
+  size_t blocks_per_slice = (num_blocks + num_slices - 1) / num_slices;
+  std::vector<double> slice_sums(num_slices * size, 0.0);
+  auto evaluate_slices = [&](size_t first_slice, size_t last_slice) {
+    for (size_t slice = first_slice; slice < last_slice; slice++) {
+      double* sums = slice_sums.data() + slice * size;
+      size_t slice_end = std::min((slice + 1) * blocks_per_slice * BLOCK_SIZE, num_rows);
+      for (size_t block = slice * blocks_per_slice * BLOCK_SIZE; block < slice_end; block += BLOCK_SIZE) {
+        size_t block_end = std::min(block + BLOCK_SIZE, slice_end);
+        for (size_t t = 0; t < trees.size(); t++) {
+          trees[t].evaluate(X, Y, num_rows, block, block_end, sums + offsets[t]);
+        }
+      }
+    }
+  };
+
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  num_threads = std::min(num_threads, num_slices);
+  if (num_threads == 1) {
+    evaluate_slices(0, num_slices);
+  } else {
+    size_t slices_per_thread = (num_slices + num_threads - 1) / num_threads;
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+      size_t first_slice = std::min(i * slices_per_thread, num_slices);
+      threads.push_back(std::thread(evaluate_slices, first_slice, std::min(first_slice + slices_per_thread, num_slices)));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::vector<std::vector<double>> rewards(trees.size());
+  for (size_t t = 0; t < trees.size(); t++) {
+    rewards[t].assign(slice_sums.begin() + offsets[t], slice_sums.begin() + offsets[t + 1]);
+    for (size_t slice = 1; slice < num_slices; slice++) {
+      const double* sums = slice_sums.data() + slice * size + offsets[t];
+      for (size_t k = 0; k < rewards[t].size(); k++) {
+        rewards[t][k] += sums[k];
+      }
+    }
+  }
+
+  return rewards;
+}
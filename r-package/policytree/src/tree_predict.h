@@ -0,0 +1,101 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#ifndef TREE_PREDICT_H
+#define TREE_PREDICT_H
+
+#include <vector>
+
+/**
+ * A fitted tree stored as contiguous arrays (one entry per node) for prediction.
+ *
+ * Built from the tree array returned to R (see `tree_search_rcpp`), where row `node` (in column
+ * major storage) holds: split_variable (-1 if leaf) | split_value (action_id if leaf) |
+ * left_child | right_child, all 1-indexed.
+ *
+ * A leaf is stored as a split with both children pointing back at the leaf itself, so a sample
+ * can be moved down one level at a time without checking whether it has reached a leaf: after
+ * `depth()` steps every sample is in its leaf.
+ */
+class PredictTree {
+public:
+  PredictTree(const double* tree_array, size_t num_nodes);
+
+  /**
+   * Predict the samples `begin`, ..., `end - 1` of the column major matrix X.
+   *
+   * @param X The query samples.
+   * @param num_rows The number of rows in X.
+   * @param begin The first sample to predict.
+   * @param end One past the last sample to predict.
+   * @param actions The predicted (1-indexed) action id of each sample is written to actions[sample].
+   * @param nodes The (0-indexed) leaf node of each sample is written to nodes[sample].
+   */
+  void predict(const double* X,
+               size_t num_rows,
+               size_t begin,
+               size_t end,
+               double* actions,
+               double* nodes) const;
+
+  /**
+   * Add the rewards of the samples `begin`, ..., `end - 1` of the column major matrix X to their leaves.
+   *
+   * @param X The query samples.
+   * @param Y The rewards (column major, one column per action).
+   * @param num_rows The number of rows in X and Y.
+   * @param begin The first sample.
+   * @param end One past the last sample.
+   * @param rewards The number of samples, and the sum and the sum of squares of the rewards of the predicted
+   * action, in each (0-indexed) leaf node are added to rewards[3 * node], rewards[3 * node + 1] and
+   * rewards[3 * node + 2].
+   */
+  void evaluate(const double* X,
+                const double* Y,
+                size_t num_rows,
+                size_t begin,
+                size_t end,
+                double* rewards) const;
+
+  int depth() const {
+    return max_depth;
+  }
+
+  size_t num_nodes() const {
+    return action.size();
+  }
+
+private:
+  // Move the `block_size` samples from `block` on of X from the root to their leaf nodes
+  void find_leaves(const double* X, size_t num_rows, size_t block, size_t block_size, int* node) const;
+
+  std::vector<size_t> split_var;
+  std::vector<double> split_value;
+  std::vector<int> left_child;
+  std::vector<int> right_child;
+  std::vector<double> action;
+  int max_depth;
+};
+
+// Predict all rows of X with `tree` on `num_threads` threads (0 uses all available cores).
+void predict_tree(const PredictTree& tree,
+                  const double* X,
+                  size_t num_rows,
+                  size_t num_threads,
+                  double* actions,
+                  double* nodes);
+
+/**
+ * Evaluate `trees` on all rows of X with rewards Y in one pass on `num_threads` threads (0 uses all
+ * available cores), as `PredictTree::evaluate`: for each tree, a vector with the number of samples, the
+ * reward sum and the sum of squared rewards of each node (zero for splits). The sums are taken in a fixed
+ * order, so the result is the same for any number of threads.
+ */
+std::vector<std::vector<double>> evaluate_trees(const std::vector<PredictTree>& trees,
+                                                const double* X,
+                                                const double* Y,
+                                                size_t num_rows,
+                                                size_t num_threads);
+
+#endif // TREE_PREDICT_H
@@ -0,0 +1,344 @@
+// Policy Tree (policytree).
+// https://github.com/grf-labs/policytree
+// Distributed under the MIT License.
+
+#ifndef TREE_SCORER_H
+#define TREE_SCORER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <queue>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A fitted tree in a compact binary file, and a header-only scorer that predicts one row at a time.
+ *
+ * File layout (native byte order, every block starts at a multiple of 8 bytes):
+ *
+ *  header | "PTREEMDL" | uint32 version (1) | uint32 num_nodes | uint32 num_features |
+ *         | uint32 num_actions | uint32 depth | uint32 0 |
+ *  split  | for each node, int32 split feature (0-indexed, -1 if leaf) (zero padded)
+ *  value  | for each node, float64 split value (samples with a value <= it go left; 0 if leaf)
+ *  action | for each node, uint16 action (0-indexed, 0 if not a leaf) (zero padded)
+ *  names  | for each feature, then action: uint32 length | the name's characters
+ *
+ * The nodes are in breadth first order, so the children of the k-th split (counting from 0) are
+ * nodes 2k + 1 and 2k + 2 and need not be stored. This is the order of the tree array returned to
+ * R (see `tree_search_rcpp`), without its trailing unused rows.
+ *
+ * `TreeScorer` loads the file once into an array of 16 byte nodes, and `predict` follows one row
+ * from the root to its leaf with no allocation or validation (a handful of nanoseconds per level).
+ * `TreeScorer::to_cpp` writes the tree as a C++ function with the splits inlined as constants.
+ */
+
+// A node of a `TreeScorer`: a split on `feature` at `value` with children `next` (left) and `next + 1`,
+// or, if `feature` is -1, a leaf with action `next`.
+struct ScorerNode {
+  double value;
+  int32_t feature;
+  uint32_t next;
+};
+
+class TreeScorer {
+public:
+  // Load the tree file at `path`, throws a std::runtime_error if it is not a valid tree file
+  explicit TreeScorer(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+      throw std::runtime_error("Could not open the tree file " + path + ".");
+    }
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    load(bytes.data(), bytes.size());
+  }
+
+  // Load a tree file read into memory, throws a std::runtime_error if it is not valid
+  TreeScorer(const char* data, size_t size) {
+    load(data, size);
+  }
+
+  // The 0-indexed action of the row whose feature j is row[j * stride] (stride 1 for a row of a row major
+  // matrix, or the number of rows for a row of a column major matrix). Missing values go right.
+  size_t predict(const double* row, size_t stride = 1) const {
+    const ScorerNode* node = nodes.data();
+    while (node->feature >= 0) {
+      node = &nodes[node->next + (row[node->feature * stride] <= node->value ? 0 : 1)];
+    }
+    return node->next;
+  }
+
+  /**
+   * The tree as C++ source: an inline function `name(const double* x)` returning the 0-indexed action
+   * of the row x (with x[j] feature j), as nested comparisons to the split values (written exactly).
+   * The feature and action names are written in comments, quoted and escaped as string literals so that
+   * no name can end a comment early. Throws a std::invalid_argument if `name` is not a C++ identifier.
+   */
+  std::string to_cpp(const std::string& name) const {
+    bool identifier = !name.empty() && !(name[0] >= '0' && name[0] <= '9');
+    for (char c : name) {
+      identifier = identifier && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                                  c == '_');
+    }
+    if (!identifier) {
+      throw std::invalid_argument("The function name \"" + name + "\" is not a C++ identifier.");
+    }
+    std::ostringstream out;
+    out << "// Generated by policytree: a depth " << tree_depth << " tree on " << feature_names.size()
+        << " features and " << action_names.size() << " actions.\n";
+    out << "inline int " << name << "(const double* x) {\n";
+    write_cpp(out, 0, 1);
+    out << "}\n";
+    return out.str();
+  }
+
+  // The nodes as written to the file (see `ScorerNode`), in breadth first order
+  const std::vector<ScorerNode>& get_nodes() const {
+    return nodes;
+  }
+
+  size_t num_features() const {
+    return feature_names.size();
+  }
+
+  size_t num_actions() const {
+    return action_names.size();
+  }
+
+  int depth() const {
+    return tree_depth;
+  }
+
+  const std::vector<std::string>& get_feature_names() const {
+    return feature_names;
+  }
+
+  const std::vector<std::string>& get_action_names() const {
+    return action_names;
+  }
+
+  static const uint32_t VERSION = 1;
+
+private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t num_features;
+    uint32_t num_actions;
+    uint32_t depth;
+    uint32_t unused;
+  };
+
+  void load(const char* data, size_t size) {
+    Header header;
+    if (size < sizeof(header)) {
+      throw std::runtime_error("The tree file is truncated.");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, "PTREEMDL", 8) != 0) {
+      throw std::runtime_error("Not a policytree tree file.");
+    }
+    if (header.version != VERSION) {
+      throw std::runtime_error("Unsupported tree file version " + std::to_string(header.version) + ".");
+    }
+    if (header.num_nodes == 0 || header.num_nodes % 2 == 0 || header.num_features == 0 || header.num_actions == 0) {
+      throw std::runtime_error("The tree file is corrupt.");
+    }
+    size_t num_nodes = header.num_nodes;
+    size_t split_size = padded(num_nodes * sizeof(int32_t));
+    size_t value_size = num_nodes * sizeof(double);
+    size_t action_size = padded(num_nodes * sizeof(uint16_t));
+    if (size - sizeof(header) < split_size + value_size + action_size) {
+      throw std::runtime_error("The tree file is truncated.");
+    }
+    const char* split = data + sizeof(header);
+    const char* value = split + split_size;
+    const char* action = value + value_size;
+    const char* names = action + action_size;
+    const char* end = data + size;
+
+    nodes.resize(num_nodes);
+    size_t num_splits = 0;
+    for (size_t i = 0; i < num_nodes; i++) {
+      int32_t feature;
+      uint16_t leaf_action;
+      std::memcpy(&feature, split + i * sizeof(int32_t), sizeof(feature));
+      std::memcpy(&nodes[i].value, value + i * sizeof(double), sizeof(double));
+      std::memcpy(&leaf_action, action + i * sizeof(uint16_t), sizeof(leaf_action));
+      if (feature >= 0) {
+        // (the children come after the split, so every row reaches a leaf)
+        if (static_cast<uint32_t>(feature) >= header.num_features || 2 * num_splits + 2 >= num_nodes ||
+            2 * num_splits + 1 <= i) {
+          throw std::runtime_error("The tree file is corrupt.");
+        }
+        nodes[i].feature = feature;
+        nodes[i].next = static_cast<uint32_t>(2 * num_splits + 1);
+        num_splits++;
+      } else {
+        if (feature != -1 || leaf_action >= header.num_actions) {
+          throw std::runtime_error("The tree file is corrupt.");
+        }
+        nodes[i].feature = -1;
+        nodes[i].next = leaf_action;
+      }
+    }
+    // (every node but the root is the child of exactly one split)
+    if (2 * num_splits + 1 != num_nodes) {
+      throw std::runtime_error("The tree file is corrupt.");
+    }
+    tree_depth = static_cast<int>(header.depth);
+    feature_names = read_names(&names, end, header.num_features);
+    action_names = read_names(&names, end, header.num_actions);
+  }
+
+  static size_t padded(size_t bytes) {
+    return (bytes + 7) / 8 * 8;
+  }
+
+  static std::vector<std::string> read_names(const char** pos, const char* end, size_t count) {
+    std::vector<std::string> names(count);
+    for (size_t j = 0; j < count; j++) {
+      uint32_t length;
+      if (static_cast<size_t>(end - *pos) < sizeof(length)) {
+        throw std::runtime_error("The tree file is truncated.");
+      }
+      std::memcpy(&length, *pos, sizeof(length));
+      *pos += sizeof(length);
+      if (static_cast<size_t>(end - *pos) < length) {
+        throw std::runtime_error("The tree file is truncated.");
+      }
+      names[j].assign(*pos, length);
+      *pos += length;
+    }
+    return names;
+  }
+
+  // `name` as a string literal, which has no line breaks and ends in a quote (so a name can neither end
+  // the comment it is written in, nor continue it on the next line with a trailing backslash)
+  static std::string quoted(const std::string& name) {
+    std::string literal = "\"";
+    for (char c : name) {
+      unsigned char byte = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\') {
+        literal += '\\';
+        literal += c;
+      } else if (byte < 0x20 || byte == 0x7f) {
+        char escape[8];
+        std::snprintf(escape, sizeof(escape), "\\x%02x", byte);
+        literal += escape;
+      } else {
+        literal += c;
+      }
+    }
+    return literal + "\"";
+  }
+
+  void write_cpp(std::ostringstream& out, size_t i, int level) const {
+    std::string indent(2 * level, ' ');
+    const ScorerNode& node = nodes[i];
+    if (node.feature < 0) {
+      out << indent << "return " << node.next << "; // " << quoted(action_names[node.next]) << "\n";
+      return;
+    }
+    char value[32];
+    std::snprintf(value, sizeof(value), "%.17g", node.value);
+    out << indent << "if (x[" << node.feature << "] <= " << value << ") { // "
+        << quoted(feature_names[node.feature]) << "\n";
+    write_cpp(out, node.next, level + 1);
+    out << indent << "} else {\n";
+    write_cpp(out, node.next + 1, level + 1);
+    out << indent << "}\n";
+  }
+
+  std::vector<ScorerNode> nodes;
+  int tree_depth;
+  std::vector<std::string> feature_names;
+  std::vector<std::string> action_names;
+};
+
+/**
+ * A tree file (see `TreeScorer`) of the tree array returned to R (see `tree_search_rcpp`): a column
+ * major `num_rows` x 4 matrix with a row per node, holding split_variable (-1 if leaf) | split_value
+ * (action if leaf) | left_child | right_child, all 1-indexed. The nodes reachable from the root are
+ * written in breadth first order. Throws a std::invalid_argument if there are more than 65535 actions.
+ */
+inline std::string serialize_tree(const double* tree_array,
+                                  size_t num_rows,
+                                  const std::vector<std::string>& feature_names,
+                                  const std::vector<std::string>& action_names) {
+  if (action_names.size() > 65535) {
+    throw std::invalid_argument("A tree file can not store more than 65535 actions.");
+  }
+  const double* column_var = tree_array;
+  const double* column_value = tree_array + num_rows;
+  const double* column_left = tree_array + 2 * num_rows;
+  const double* column_right = tree_array + 3 * num_rows;
+
+  std::vector<int32_t> split;
+  std::vector<double> value;
+  std::vector<uint16_t> action;
+  uint32_t depth = 0;
+  // (row, level) pairs in breadth first order
+  std::queue<std::pair<size_t, uint32_t>> frontier;
+  frontier.push(std::make_pair(static_cast<size_t>(0), 0u));
+  while (!frontier.empty()) {
+    size_t row = frontier.front().first;
+    uint32_t level = frontier.front().second;
+    frontier.pop();
+    depth = std::max(depth, level);
+    if (column_var[row] == -1) {
+      split.push_back(-1);
+      value.push_back(0);
+      action.push_back(static_cast<uint16_t>(column_value[row] - 1));
+    } else {
+      split.push_back(static_cast<int32_t>(column_var[row] - 1));
+      value.push_back(column_value[row]);
+      action.push_back(0);
+      frontier.push(std::make_pair(static_cast<size_t>(column_left[row] - 1), level + 1));
+      frontier.push(std::make_pair(static_cast<size_t>(column_right[row] - 1), level + 1));
+    }
+  }
+
+  uint32_t num_nodes = static_cast<uint32_t>(split.size());
+  uint32_t header[6] = {TreeScorer::VERSION, num_nodes, static_cast<uint32_t>(feature_names.size()),
+                        static_cast<uint32_t>(action_names.size()), depth, 0};
+  std::string out("PTREEMDL");
+  out.append(reinterpret_cast<const char*>(header), sizeof(header));
+  out.append(reinterpret_cast<const char*>(split.data()), num_nodes * sizeof(int32_t));
+  out.resize((out.size() + 7) / 8 * 8, '\0');
+  out.append(reinterpret_cast<const char*>(value.data()), num_nodes * sizeof(double));
+  out.append(reinterpret_cast<const char*>(action.data()), num_nodes * sizeof(uint16_t));
+  out.resize((out.size() + 7) / 8 * 8, '\0');
+  for (const std::vector<std::string>* names : {&feature_names, &action_names}) {
+    for (const auto& name : *names) {
+      uint32_t length = static_cast<uint32_t>(name.size());
+      out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+      out.append(name);
+    }
+  }
+
+  return out;
+}
+
+// Write `serialize_tree` of the tree array to the file at `path`
+inline void write_tree_file(const std::string& path,
+                            const double* tree_array,
+                            size_t num_rows,
+                            const std::vector<std::string>& feature_names,
+                            const std::vector<std::string>& action_names) {
+  std::string bytes = serialize_tree(tree_array, num_rows, feature_names, action_names);
+  std::ofstream out(path, std::ios::binary);
+  out.write(bytes.data(), bytes.size());
+  if (!out) {
+    throw std::runtime_error("Could not write the tree file " + path + ".");
+  }
+}
+
+#endif // TREE_SCORER_H
@@ -2,26 +2,203 @@
 // https://github.com/grf-labs/policytree
 // Distributed under the MIT License.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
 #include <functional>
-#include <boost/container/flat_set.hpp>
+#include <limits>
+#include <thread>
+#include <utility>
 
+#include "sorted_sets.h"
+#include "subproblem_cache.h"
 #include "tree_search.h"
 
-typedef boost::container::flat_set<Point, std::function<bool(const Point&, const Point&)>> flat_set;
+// Whether a value is missing: NaN, or R's NA_integer_ for integers
+bool is_missing(double value) {
+  return std::isnan(value);
+}
+
+bool is_missing(int32_t value) {
+  return value == std::numeric_limits<int32_t>::min();
+}
+
+
+LevelStats& LevelStats::operator+=(const LevelStats& other) {
+  num_nodes += other.num_nodes;
+  num_pruned += other.num_pruned;
+  num_evaluated += other.num_evaluated;
+  num_ties += other.num_ties;
+  num_too_small += other.num_too_small;
+  num_stepped_over += other.num_stepped_over;
+  num_partitioned += other.num_partitioned;
+  seconds += other.seconds;
+  return *this;
+}
+
+
+template <typename DataType>
+DataSummary summarize_data(const DataType* data, bool count_distinct) {
+  size_t num_rows = data->num_rows;
+  DataSummary summary;
+  std::vector<double> column;
+  if (count_distinct) {
+    column.resize(num_rows);
+    summary.cardinality.resize(data->num_features());
+  }
+
+  for (size_t j = 0; j < data->num_features(); j++) {
+    bool missing = false;
+    for (size_t i = 0; i < num_rows; i++) {
+      auto value = data->get_x(i, j);
+      missing |= is_missing(value);
+      if (count_distinct) {
+        column[i] = value;
+      }
+    }
+    summary.missing_x |= missing;
+    if (count_distinct && !missing) {
+      std::sort(column.begin(), column.end());
+      summary.cardinality[j] = std::unique(column.begin(), column.end()) - column.begin();
+    }
+  }
+  for (size_t d = 0; d < data->num_rewards(); d++) {
+    for (size_t i = 0; i < num_rows; i++) {
+      summary.missing_y |= is_missing(data->get_y(i, d));
+    }
+  }
+
+  return summary;
+}
+
 
 /**
- * Create a vector of sorted sets
+ * Coordinate compress the features
  *
  * @param data: the data class
- * @param make_empty: boolean, whether to fill the sets with points or not.
- * @return a vector (size data->num_features()) of sorted sets, each set containing
- *  data->num_points points where set at index j is sorted along dimension j
- *  (empty if `make_empty=true`, but new points will be sorted along dimension j).
+ * @param max_bins: if greater than zero, features with more than `max_bins` distinct values are
+ *  binned into at most `max_bins` quantile bins.
+ * @return the dense rank of every sample along every feature (see `SampleRanks`), along with
+ *  the distinct values of every feature.
+ *
+ * Each column is sorted once, as contiguous (value, sample) pairs.
+ *
+ * Binning is an approximation: samples in the same bin share a rank, so the search can only split
+ * between bins, and the number of split candidates along a feature is at most `max_bins` instead
+ * of its number of distinct values. A bin is closed at the first change in value after another
+ * 1 / `max_bins` share of the samples, and is represented by its largest value, so that
+ * "value <= split value" sends the entire bin left. (Runs of tied values are never split up, so
+ * a heavily tied value may make up a bin by itself.)
+ */
+template <typename DataType>
+SampleRanks<uint32_t> compress_features(const DataType* data, size_t max_bins) {
+  size_t num_rows = data->num_rows;
+  SampleRanks<uint32_t> ranks(num_rows, data->num_features());
+  std::vector<std::pair<double, size_t>> keys(num_rows);
+
+  for (size_t j = 0; j < data->num_features(); j++) {
+    for (size_t i = 0; i < num_rows; i++) {
+      keys[i] = std::make_pair(data->get_x(i, j), i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    size_t num_distinct = 1;
+    for (size_t i = 1; i < num_rows; i++) {
+      if (keys[i].first != keys[i - 1].first) {
+        num_distinct++;
+      }
+    }
+    size_t num_bins = (max_bins > 0 && num_distinct > max_bins) ? max_bins : 0;
+
+    uint32_t rank = 0;
+    for (size_t i = 0; i < num_rows; i++) {
+      if (i > 0 && keys[i].first != keys[i - 1].first &&
+          (num_bins == 0 || i * num_bins >= (rank + 1) * num_rows)) {
+        ranks.add_value(j, keys[i - 1].first);
+        rank++;
+      }
+      ranks.set(keys[i].second, j, rank);
+    }
+    ranks.add_value(j, keys[num_rows - 1].first);
+  }
+
+  return ranks;
+}
+
+
+template <typename DataType>
+std::vector<std::vector<size_t>> feature_value_counts(const DataType* data, size_t max_bins) {
+  SampleRanks<uint32_t> ranks = compress_features(data, max_bins);
+  std::vector<std::vector<size_t>> value_counts(ranks.num_features());
+  for (size_t j = 0; j < ranks.num_features(); j++) {
+    value_counts[j].assign(ranks.num_values(j), 0);
+    for (size_t i = 0; i < ranks.num_samples(); i++) {
+      value_counts[j][ranks.get(i, j)]++;
+    }
+  }
+
+  return value_counts;
+}
+
+
+size_t count_split_candidates(const std::vector<size_t>& value_counts, int split_step, size_t min_node_size) {
+  size_t node_size = 0;
+  for (size_t count : value_counts) {
+    node_size += count;
+  }
+  // the sweep of `level_one_sweep`, a value at a time (a position within a value is a tie)
+  size_t num_candidates = 0;
+  size_t split_counter = 0;
+  size_t samples_counter = 0;
+  for (size_t r = 0; r + 1 < value_counts.size(); r++) {
+    split_counter += value_counts[r];
+    samples_counter += value_counts[r];
+    if (samples_counter < min_node_size || node_size - samples_counter < min_node_size) {
+      continue;
+    }
+    if (split_counter >= static_cast<size_t>(split_step)) {
+      split_counter = 0;
+      num_candidates++;
+    }
+  }
+
+  return num_candidates;
+}
+
+
+// Copy the (column major) rewards in data to row major storage, multiplied by the sample weights
+template <typename DataType>
+RewardRows create_reward_rows(const DataType* data) {
+  RewardRows rewards(data->num_rows, data->num_rewards());
+  const double* weights = data->get_weights();
+  for (size_t i = 0; i < data->num_rows; i++) {
+    double* row = rewards.get(i);
+    double weight = weights == nullptr ? 1 : weights[i];
+    for (size_t d = 0; d < data->num_rewards(); d++) {
+      row[d] = weight * data->get_y(i, d);
+    }
+  }
+  rewards.compute_bounds();
+
+  return rewards;
+}
+
+
+/**
+ * Create the root sorted sets
+ *
+ * @param ranks: the coordinate compressed features
+ * @param weights: the sample weights (or null). Samples with weight zero are left out.
+ * @param storage: the memory the returned sets are stored in.
+ * @return the sorted sets for all samples, where array j contains
+ *  all samples sorted along dimension j (ties in value are broken by sample index).
  *
  *  Details:
  *                         1, ...,        j            p      1, ...,         d
  *                        +----------------------------+      +---------------+
- *  Point {} +-------->   |                            |      |               |
+ *  sample i  +------->   |                            |      |               |
  *                        |                            |      |               |
  *  (sample i sorted      |                            |      |               |
  *  according to          |                            |      |               |
@@ -38,166 +215,1465 @@ typedef boost::container::flat_set<Point, std::function<bool(const Point&, const
  *                                     v
  *
  *                        +----+----+------------------+
- * <Vector> sorted_sets   | +  |    |                  |
+ *  sorted_sets           | +  |    |                  |
  *                        | |  |    |                  |
  *                        +----+----+------------------+
  *                          |
  *                          |
  *                          v
- *                     All points
+ *                     All samples
  *                     sorted along
  *                     dimension 1
  *
+ * Since the ranks are dense, each dimension is a counting sort (O(n + number of distinct values)),
+ * which is stable and so breaks ties by sample index. This is the only place samples are sorted:
+ * the sorted sets of child nodes are obtained by stable partitions of their parent's
+ * (see `partition_sorted_sets`).
+ */
+template <typename Ranks>
+SortedSets create_sorted_sets(const Ranks& ranks, const double* weights, std::vector<uint32_t>& storage) {
+  size_t num_rows = ranks.num_samples();
+  size_t num_points = num_rows;
+  if (weights != nullptr) {
+    num_points = std::count_if(weights, weights + num_rows, [](double weight) { return weight > 0; });
+  }
+  storage.resize(ranks.num_features() * num_points);
+  SortedSets res(storage.data(), num_points);
+  std::vector<size_t> offsets;
+
+  for (size_t j = 0; j < ranks.num_features(); j++) {
+    offsets.assign(ranks.num_values(j) + 1, 0);
+    for (size_t i = 0; i < num_rows; i++) {
+      if (weights == nullptr || weights[i] > 0) {
+        offsets[ranks.get(i, j) + 1]++;
+      }
+    }
+    for (size_t r = 1; r < offsets.size(); r++) {
+      offsets[r] += offsets[r - 1];
+    }
+    uint32_t* setj = res.begin(j);
+    for (size_t i = 0; i < num_rows; i++) {
+      if (weights == nullptr || weights[i] > 0) {
+        setj[offsets[ranks.get(i, j)]++] = static_cast<uint32_t>(i);
+      }
+    }
+  }
+
+  return res;
+}
+
+
+/**
+ * Split the sorted sets of a node into those of its two children.
  *
- * A boost::flat_set is used over a stl::set since the flat_set is contiguous and
- * allows for faster iteration.
+ * The first `left_sorted_sets.size()` samples along feature `p` go to the left child, the rest
+ * (`right_sorted_sets.size()`) to the right.
+ * Splits are only made where the value along `p` changes, so a sample is on the left iff its
+ * rank along `p` is at most that of the last left sample, and every other feature's array is
+ * split with one stable pass over it. This preserves the sort order (and the sample index
+ * tie-breaking) exactly, in O(p * num_points).
  */
-std::vector<flat_set> create_sorted_sets(const Data* data, bool make_empty=false) {
-  std::vector<flat_set> res;
-  res.reserve(data->num_features());
-
-  for (size_t cmp_dim = 0; cmp_dim < data->num_features(); cmp_dim++) {
-    auto cmp_func = [cmp_dim](const Point& lhs, const Point& rhs) {
-      // if covariates have the same value use the sample index as tie-breaker
-      const auto &a = lhs.get_value(cmp_dim);
-      const auto &b = rhs.get_value(cmp_dim);
-      if (a == b) {
-        return lhs.sample < rhs.sample;
+template <typename Ranks>
+void partition_sorted_sets(const SortedSets& sorted_sets,
+                           size_t p,
+                           const Ranks& ranks,
+                           SortedSets& left_sorted_sets,
+                           SortedSets& right_sorted_sets) {
+  size_t num_points = sorted_sets.size();
+  size_t num_features = ranks.num_features();
+  size_t num_left = left_sorted_sets.size();
+  uint32_t split_rank = ranks.get(sorted_sets.begin(p)[num_left - 1], p);
+
+  for (size_t j = 0; j < num_features; j++) {
+    const uint32_t* setj = sorted_sets.begin(j);
+    uint32_t* left = left_sorted_sets.begin(j);
+    uint32_t* right = right_sorted_sets.begin(j);
+    if (j == p) {
+      std::copy(setj, setj + num_left, left);
+      std::copy(setj + num_left, setj + num_points, right);
+      continue;
+    }
+    for (size_t i = 0; i < num_points; i++) {
+      uint32_t sample = setj[i];
+      if (ranks.get(sample, p) <= split_rank) {
+        *left++ = sample;
       } else {
-        return a < b;
+        *right++ = sample;
       }
-    };
+    }
+  }
+}
+
+
+/**
+ * The sorted sets of the samples with a positive weight (the root sorted sets of a weighted search).
+ *
+ * One stable pass over each feature's array, so the samples keep their sort order (and sample index
+ * tie-breaking) without being sorted again, in O(p * N).
+ */
+SortedSets positive_weight_sets(const SortedSets& sorted_sets,
+                                size_t num_features,
+                                const double* weights,
+                                std::vector<uint32_t>& storage) {
+  size_t num_points = 0;
+  for (const uint32_t* sample = sorted_sets.begin(0); sample != sorted_sets.end(0); ++sample) {
+    num_points += weights[*sample] > 0;
+  }
+  storage.resize(num_features * num_points);
+  SortedSets res(storage.data(), num_points);
+  for (size_t j = 0; j < num_features; j++) {
+    uint32_t* setj = res.begin(j);
+    for (const uint32_t* sample = sorted_sets.begin(j); sample != sorted_sets.end(j); ++sample) {
+      if (weights[*sample] > 0) {
+        *setj++ = *sample;
+      }
+    }
+  }
+
+  return res;
+}
+
+
+/**
+ * Collapse the samples with the same rank along every feature into one sample.
+ *
+ * The search only sees the ranks, so such samples (identical rows of X, or rows in the same bins
+ * with `max_bins`) always end up in the same leaf. Each group is replaced by one sample with the sum of
+ * their (weighted) rewards and their count (see `RewardRows`), which gives the same tree: the sweeps
+ * count samples by their counts, so `min_node_size` and `split_step` see the original samples.
+ * Samples with weight zero are left out, so the collapsed samples are unweighted.
+ *
+ * The samples are grouped by a least significant digit radix sort of their ranks (a stable counting
+ * sort along each feature, from the last to the first), in O(p(N + number of distinct values)).
+ *
+ * @return whether any samples were collapsed (if not, `ranks` and `rewards` are left as they are)
+ */
+bool collapse_duplicates(SampleRanks<uint32_t>& ranks, RewardRows& rewards, const double* weights) {
+  size_t num_rows = ranks.num_samples();
+  size_t num_features = ranks.num_features();
+  size_t num_rewards = rewards.num_rewards();
+
+  std::vector<uint32_t> order;
+  for (size_t i = 0; i < num_rows; i++) {
+    if (weights == nullptr || weights[i] > 0) {
+      order.push_back(static_cast<uint32_t>(i));
+    }
+  }
+  std::vector<uint32_t> sorted(order.size());
+  std::vector<size_t> offsets;
+  for (size_t j = num_features; j-- > 0;) {
+    offsets.assign(ranks.num_values(j) + 1, 0);
+    for (uint32_t sample : order) {
+      offsets[ranks.get(sample, j) + 1]++;
+    }
+    for (size_t r = 1; r < offsets.size(); r++) {
+      offsets[r] += offsets[r - 1];
+    }
+    for (uint32_t sample : order) {
+      sorted[offsets[ranks.get(sample, j)]++] = sample;
+    }
+    order.swap(sorted);
+  }
+
+  // samples with the same ranks are now consecutive
+  auto same_ranks = [&](uint32_t a, uint32_t b) {
+    for (size_t j = 0; j < num_features; j++) {
+      if (ranks.get(a, j) != ranks.get(b, j)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  size_t num_groups = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    num_groups += i == 0 || !same_ranks(order[i - 1], order[i]);
+  }
+  if (num_groups == num_rows) {
+    return false;
+  }
+
+  SampleRanks<uint32_t> collapsed_ranks(num_groups, num_features);
+  for (size_t j = 0; j < num_features; j++) {
+    for (size_t r = 0; r < ranks.num_values(j); r++) {
+      collapsed_ranks.add_value(j, ranks.get_value(j, static_cast<uint32_t>(r)));
+    }
+  }
+  RewardRows collapsed_rewards(num_groups, num_rewards);
+  std::vector<uint32_t> counts(num_groups, 0);
+  size_t group = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    if (i > 0 && !same_ranks(order[i - 1], order[i])) {
+      group++;
+    }
+    if (counts[group] == 0) {
+      for (size_t j = 0; j < num_features; j++) {
+        collapsed_ranks.set(group, j, ranks.get(order[i], j));
+      }
+    }
+    counts[group]++;
+    const double* reward = rewards.get(order[i]);
+    double* sum = collapsed_rewards.get(group);
+    for (size_t d = 0; d < num_rewards; d++) {
+      sum[d] += reward[d];
+    }
+  }
+  collapsed_rewards.set_counts(std::move(counts));
+  // (the sums the search computes are the same sums of the original rewards, in another order)
+  collapsed_rewards.compute_bounds(rewards.bound_slack());
+
+  ranks = std::move(collapsed_ranks);
+  rewards = std::move(collapsed_rewards);
+  return true;
+}
+
+
+/**
+ * A node of a tree stored in a flat buffer.
+ *
+ * A tree of depth `level` takes up `flat_tree_size(level)` nodes in preorder: the root, followed by
+ * the left subtree and then the right subtree (each a tree of depth `level - 1`), so every subtree
+ * occupies a contiguous block at a fixed offset. The nodes below a leaf are unused. This lets the
+ * recursion write subtrees into preallocated buffers instead of allocating Nodes.
+ */
+struct FlatNode {
+  FlatNode() : index(0), value(0.0), reward(-INF), action_id(0), is_leaf(true) {}
+
+  size_t index;
+  double value;
+  double reward;
+  size_t action_id;
+  bool is_leaf;
+};
+
+
+size_t flat_tree_size(int level) {
+  return (static_cast<size_t>(1) << (level + 1)) - 1;
+}
+
+
+void set_leaf(FlatNode* node, double reward, size_t action_id) {
+  node->is_leaf = true;
+  node->reward = reward;
+  node->action_id = action_id;
+}
+
+
+void set_split(FlatNode* node, size_t index, double value, double reward) {
+  node->is_leaf = false;
+  node->index = index;
+  node->value = value;
+  node->reward = reward;
+}
+
+
+// Convert the depth `level` flat tree `tree` to linked Nodes
+std::unique_ptr<Node> unflatten_tree(const FlatNode* tree, int level) {
+  if (tree->is_leaf) {
+    return std::unique_ptr<Node> (new Node(0, 0.0, tree->reward, tree->action_id));
+  }
+  auto node = std::unique_ptr<Node> (new Node(tree->index, tree->value, tree->reward, 0));
+  node->left_child = unflatten_tree(tree + 1, level - 1);
+  node->right_child = unflatten_tree(tree + flat_tree_size(level - 1) + 1, level - 1);
+
+  return node;
+}
+
+
+// The best split found so far at a level >= 2 node, stored as a depth `level` flat tree.
+// The root of `tree` is the split and is followed by the best subtrees on either side.
+struct Split {
+  Split(int level) : found(false), position(0), tree(flat_tree_size(level)) {}
+
+  bool found;
+  // the position of the split along its feature (the number of samples that go left, minus one)
+  size_t position;
+  std::vector<FlatNode> tree;
+};
+
+
+// Scratch memory of one recursion level >= 2
+struct LevelWorkspace {
+  LevelWorkspace(int level, size_t num_points, size_t num_features) :
+  children(num_points * num_features), candidate(flat_tree_size(level)), best(level) {}
+
+  // the sorted sets of both children of a split candidate (they sum to the size of the parent)
+  std::vector<uint32_t> children;
+  // the subtrees of a split candidate
+  std::vector<FlatNode> candidate;
+  Split best;
+};
+
+
+/**
+ * The progress of a tree search with a progress callback or a limit, and whether it has been cancelled.
+ *
+ * The search threads count the root split positions they have swept past (`advance`) and stop
+ * at the next split candidate once the search is cancelled (`is_cancelled`), either by the callback
+ * or by reaching `time_limit` or `max_evaluations` (which is not an error: the best tree found so far
+ * is returned). Only the thread that created the monitor calls the callback (`poll`, which is a no-op
+ * on any other thread), so a callback may call into R. While worker threads run, that thread waits in `wait`.
+ */
+class SearchMonitor {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit SearchMonitor(const SearchOptions& options) :
+  options(options), owner(std::this_thread::get_id()), start(Clock::now()), last_poll(start),
+  num_evaluated(0), num_candidates(0), best_reward(-INF), cancelled(false), stopped(false), root_level(0) {
+  }
+
+  // Start a search at depth `level` with `count` root split positions
+  void start_search(int level, size_t count) {
+    root_level = level;
+    num_candidates += count;
+  }
+
+  // Forget the root split positions of the searches so far, before the search is repeated (the positions
+  // of the searches of a hybrid tree's nodes add up instead)
+  void restart_search() {
+    num_evaluated = 0;
+    num_candidates = 0;
+  }
+
+  int get_root_level() const {
+    return root_level;
+  }
+
+  void advance(size_t count) {
+    num_evaluated.fetch_add(count, std::memory_order_relaxed);
+    poll();
+  }
+
+  // Record the reward of a root split candidate
+  void update_best(double reward) {
+    double best = best_reward.load(std::memory_order_relaxed);
+    while (reward > best && !best_reward.compare_exchange_weak(best, reward, std::memory_order_relaxed)) {
+    }
+  }
+
+  bool is_cancelled() {
+    poll();
+    if (!cancelled.load(std::memory_order_relaxed) && limit_reached()) {
+      stopped = true;
+      cancelled = true;
+    }
+    return cancelled.load(std::memory_order_relaxed);
+  }
+
+  // Whether the search was stopped by `time_limit` or `max_evaluations`
+  bool is_stopped() const {
+    return stopped.load();
+  }
+
+  // The share of root split positions searched (1 if there are none)
+  double fraction_searched() const {
+    if (num_candidates == 0) {
+      return 1;
+    }
+    return std::min(static_cast<double>(num_evaluated.load()) / num_candidates, 1.0);
+  }
+
+  // Call the progress callback if `progress_interval` seconds have passed since the last call
+  void poll() {
+    if (!options.progress || std::this_thread::get_id() != owner || cancelled.load(std::memory_order_relaxed)) {
+      return;
+    }
+    Clock::time_point now = Clock::now();
+    if (std::chrono::duration<double>(now - last_poll).count() < options.progress_interval) {
+      return;
+    }
+    last_poll = now;
+    SearchProgress progress;
+    progress.num_evaluated = num_evaluated.load(std::memory_order_relaxed);
+    progress.num_candidates = num_candidates;
+    progress.elapsed = std::chrono::duration<double>(now - start).count();
+    progress.best_reward = best_reward.load(std::memory_order_relaxed);
+    try {
+      if (!options.progress(progress)) {
+        cancelled = true;
+      }
+    } catch (...) {
+      error = std::current_exception();
+      cancelled = true;
+    }
+  }
+
+  // Poll (every 10 milliseconds) until `num_running`, the number of running worker threads, is zero
+  void wait(const std::atomic<size_t>& num_running) {
+    while (num_running.load() > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      poll();
+    }
+  }
+
+  // Throw if the search was cancelled (called once all search threads have stopped)
+  void check() const {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    if (cancelled && !stopped) {
+      throw SearchCancelled();
+    }
+  }
+
+private:
+  bool limit_reached() const {
+    if (options.max_evaluations > 0 && num_evaluated.load(std::memory_order_relaxed) >= options.max_evaluations) {
+      return true;
+    }
+    return options.time_limit > 0 &&
+      std::chrono::duration<double>(Clock::now() - start).count() >= options.time_limit;
+  }
+
+  const SearchOptions& options;
+  std::thread::id owner;
+  Clock::time_point start;
+  Clock::time_point last_poll;
+  std::atomic<size_t> num_evaluated;
+  size_t num_candidates;
+  std::atomic<double> best_reward;
+  std::atomic<bool> cancelled;
+  std::atomic<bool> stopped;
+  std::exception_ptr error;
+  int root_level;
+};
+
+
+// The largest reward of the root split candidates any thread of a parallel search has found: the
+// reward of a tree on the root's samples, which every thread can prune against.
+class SharedIncumbent {
+public:
+  SharedIncumbent() : reward(-INF) {}
+
+  double get() const {
+    return reward.load(std::memory_order_relaxed);
+  }
+
+  void update(double value) {
+    double current = reward.load(std::memory_order_relaxed);
+    while (value > current && !reward.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+  }
+
+private:
+  std::atomic<double> reward;
+};
+
+
+// A depth one flat tree (see `SubproblemCache`)
+struct LevelOneTree {
+  FlatNode nodes[3];
+};
+
+/**
+ * Scratch memory of the level two sweep (see `level_two_feature`): the reward sums (row major, one
+ * row per rank) and sample counts of the samples of a node with each rank of each feature (see
+ * `level_two_node`), and the same for its left child. Feature j's ranks are rows offsets[j], ...,
+ * offsets[j + 1] - 1.
+ */
+struct LevelTwoWorkspace {
+  LevelTwoWorkspace() : num_values(0), node_size(0) {}
+
+  template <typename Ranks>
+  LevelTwoWorkspace(const Ranks& ranks, size_t num_rewards) :
+  offsets(ranks.num_features() + 1, 0), node_size(0) {
+    for (size_t j = 0; j < ranks.num_features(); j++) {
+      offsets[j + 1] = offsets[j] + ranks.num_values(j);
+    }
+    num_values = offsets.back();
+    node_sums.resize(num_values * num_rewards);
+    left_sums.resize(num_values * num_rewards);
+    node_counts.resize(num_values);
+    left_counts.resize(num_values);
+    node_total.resize(num_rewards);
+    left_total.resize(num_rewards);
+    child_total.resize(num_rewards);
+    child_sum.resize(num_rewards);
+  }
+
+  std::vector<size_t> offsets;
+  // the total number of ranks (of all features), 0 if the sweep is not used
+  size_t num_values;
+  std::vector<double> node_sums;
+  std::vector<double> left_sums;
+  std::vector<size_t> node_counts;
+  std::vector<size_t> left_counts;
+  std::vector<double> node_total;
+  // the number of samples of the node
+  size_t node_size;
+  std::vector<double> left_total;
+  std::vector<double> child_total;
+  std::vector<double> child_sum;
+};
+
+/**
+ * The scratch memory of a tree search thread, for searches of at most `num_points` samples.
+ *
+ * Everything the recursion writes to is allocated up front, sized by the number of samples,
+ * features, and rewards, so the recursion itself only allocates as the subproblem cache fills up
+ * (up to the cache's budget). Every call at a recursion level has returned before its sibling is
+ * called, so one workspace per level (index = level) suffices. A level l node has at most
+ * num_points - (depth - l) samples (each split above it leaves one out), which its children's
+ * sorted sets take up along every feature: about 4 N p (depth - 1) bytes in all for N samples and
+ * p features, besides the 8 N d bytes of `sum_array` (for d actions).
+ */
+struct Workspace {
+  template <typename Ranks>
+  Workspace(int depth, size_t num_points, const Ranks& ranks, const RewardRows& rewards) :
+  sum_array((num_points + 1) * rewards.num_rewards(), 0.0),
+  reward_sum(rewards.num_rewards()),
+  monitor(nullptr),
+  root_incumbent(nullptr),
+  root_level(0) {
+    for (int level = 0; level <= depth; level++) {
+      size_t level_points = num_points - std::min(static_cast<size_t>(depth - level), num_points);
+      levels.push_back(LevelWorkspace(level >= 2 ? level : 0,
+                                      level >= 2 ? level_points : 0,
+                                      ranks.num_features()));
+    }
+    // The level two sweep is only set up if the features have many ties, where it pays off (its per
+    // rank sums then take up at most the memory of a level's sorted sets)
+    size_t num_values = 0;
+    for (size_t j = 0; j < ranks.num_features(); j++) {
+      num_values += ranks.num_values(j);
+    }
+    if (depth >= 2 && 4 * num_values * rewards.num_rewards() <= ranks.num_features() * ranks.num_samples()) {
+      level_two = LevelTwoWorkspace(ranks, rewards.num_rewards());
+    }
+  }
+
+  // A zero initialized row major (num_points + 1) x (num_rewards) array which is used to
+  // calculate cumulative rewards: row n holds the reward sums of every action over the first
+  // n samples (row 0 is zero).
+  std::vector<double> sum_array;
+  std::vector<double> reward_sum;
+  std::vector<LevelWorkspace> levels;
+  LevelTwoWorkspace level_two;
+  SearchStats stats;
+  // The depth one subtrees found by this thread (disabled unless the search has depth >= 3)
+  SubproblemCache<LevelOneTree> level_one_cache;
+  // The monitor of the search (null without a progress callback or a limit)
+  SearchMonitor* monitor;
+  // The incumbent the root level `root_level` of a parallel search prunes against (null unless the
+  // search runs on several threads with bound pruning)
+  SharedIncumbent* root_incumbent;
+  int root_level;
+
+  // The counters of recursion level `level`, and the seconds spent on root feature p (null unless
+  // the search is profiled)
+  LevelStats* level_stats(int level) {
+    return stats.levels.empty() ? nullptr : &stats.levels[level];
+  }
+
+  double* feature_seconds(size_t p) {
+    return stats.feature_seconds.empty() ? nullptr : &stats.feature_seconds[p];
+  }
+
+  // The bytes of scratch memory allocated up front (the subproblem cache aside)
+  size_t memory() const {
+    size_t bytes = sum_array.size() * sizeof(double);
+    for (const auto& level : levels) {
+      bytes += level.children.size() * sizeof(uint32_t);
+    }
+    bytes += (level_two.node_sums.size() + level_two.left_sums.size()) * sizeof(double);
+    bytes += (level_two.node_counts.size() + level_two.left_counts.size()) * sizeof(size_t);
+    return bytes;
+  }
+};
+
+
+// Adds the seconds from its construction to its destruction to `*seconds` (unless it is null)
+class ScopedTimer {
+public:
+  explicit ScopedTimer(double* seconds) : seconds(seconds) {
+    if (seconds != nullptr) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ScopedTimer() {
+    if (seconds != nullptr) {
+      *seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+
+private:
+  double* seconds;
+  std::chrono::steady_clock::time_point start;
+};
+
+
+// Add the `num_positions` split positions a sweep passed to `level_stats` (unless it is null): those
+// evaluated and skipped by min_node_size or split_step are counted, the rest are ties (which keeps the
+// counting out of the sweeps' most frequent branch)
+void add_positions(LevelStats* level_stats,
+                   size_t num_positions,
+                   size_t num_evaluated,
+                   size_t num_too_small,
+                   size_t num_stepped_over) {
+  if (level_stats != nullptr) {
+    level_stats->num_evaluated += num_evaluated;
+    level_stats->num_ties += num_positions - num_evaluated - num_too_small - num_stepped_over;
+    level_stats->num_too_small += num_too_small;
+    level_stats->num_stepped_over += num_stepped_over;
+  }
+}
+
+
+// Count a node pruned by its reward bound in `level_stats` (unless it is null)
+void count_pruned(LevelStats* level_stats) {
+  if (level_stats != nullptr) {
+    level_stats->num_nodes++;
+    level_stats->num_pruned++;
+  }
+}
+
+
+// Find the best action in a leaf node (O(nd))
+void level_zero_learning(const SortedSets& sorted_sets,
+                         const RewardRows& rewards,
+                         Workspace& workspace,
+                         FlatNode* tree) {
+  size_t num_rewards = rewards.num_rewards();
+  size_t best_action = 0;
+  double best_reward = -INF;
+
+  std::vector<double>& reward_sum = workspace.reward_sum;
+  std::fill(reward_sum.begin(), reward_sum.end(), 0.0);
+
+  for (const uint32_t* it = sorted_sets.begin(0); it != sorted_sets.end(0); ++it) {
+    const double* reward = rewards.get(*it);
+    for (size_t d = 0; d < num_rewards; d++) {
+      reward_sum[d] += reward[d];
+    }
+  }
+  for (size_t d = 0; d < num_rewards; d++) {
+    if (reward_sum[d] > best_reward) {
+      best_reward = reward_sum[d];
+      best_action = d;
+    }
+  }
+
+  set_leaf(tree, best_reward, best_action);
+}
+
+
+// The best depth one split found so far, along with the optimal actions in both leaves.
+struct LevelOneSplit {
+  LevelOneSplit() :
+  reward(-INF), left_reward(-INF), right_reward(-INF),
+  left_action(0), right_action(0), split_var(0), split_val(0.0), position(0) {}
+
+  double reward;
+  double left_reward;
+  double right_reward;
+  size_t left_action;
+  size_t right_action;
+  size_t split_var;
+  double split_val;
+  size_t position;
+};
 
-    flat_set setj(cmp_func);
-    if (!make_empty) {
-      setj.reserve(data->num_rows);
-      for (size_t i = 0; i < data->num_rows; i++) {
-        setj.emplace(i, data);
+
+// Find the best depth one split along feature p at positions `begin` <= k < `end` (<= N - 1),
+// updating `best` if it is improved upon (O(nd)). The number of actions is `NumRewards`, a compile time
+// constant the loops over actions are unrolled for, or `rewards.num_rewards()` if `NumRewards` is 0.
+// If `Counted`, the positions evaluated and skipped are added to `level_stats` (if not null); otherwise
+// the sweep keeps no counters (they measurably slow down the innermost loop of the search).
+template <size_t NumRewards, bool Counted, typename Ranks>
+void level_one_sweep(size_t p,
+                     const SortedSets& sorted_sets,
+                     const RewardRows& rewards,
+                     const Ranks& ranks,
+                     std::vector<double>& sum_array,
+                     const SearchOptions& options,
+                     size_t begin,
+                     size_t end,
+                     LevelOneSplit& best,
+                     LevelStats* level_stats) {
+  size_t num_points = sorted_sets.size();
+  size_t num_rewards = NumRewards > 0 ? NumRewards : rewards.num_rewards();
+  const uint32_t* setp = sorted_sets.begin(p);
+  const uint32_t* counts = rewards.get_counts();
+
+  // Fill the reward matrix with cumulative sums. Each sample's rewards are read as one contiguous
+  // row, and the loops over actions run over contiguous memory (and can be vectorized).
+  double* sums = sum_array.data();
+  for (size_t n = 0; n < num_points; n++) {
+    const double* reward = rewards.get(setp[n]);
+    const double* previous = sums + n * num_rewards;
+    double* current = sums + (n + 1) * num_rewards;
+    for (size_t d = 0; d < num_rewards; d++) {
+      current[d] = previous[d] + reward[d];
+    }
+  }
+  size_t node_size = num_points;
+  if (counts != nullptr) {
+    node_size = 0;
+    for (size_t n = 0; n < num_points; n++) {
+      node_size += counts[setp[n]];
+    }
+  }
+  const double* total = sums + num_points * num_rewards;
+
+  int split_counter = 0;
+  size_t samples_counter = 0;
+  // (the positions before `begin` are not counted)
+  size_t num_too_small = 0, num_stepped_over = 0, num_evaluated = 0;
+  for (size_t n = 1; n <= end; n++) {
+    uint32_t value = ranks.get(setp[n - 1], p);
+    uint32_t next_value = ranks.get(setp[n], p);
+    uint32_t count = counts == nullptr ? 1 : counts[setp[n - 1]];
+    split_counter += count;
+    samples_counter += count;
+    if (value == next_value) {
+      continue;
+    }
+    if (samples_counter < options.min_node_size || node_size - samples_counter < options.min_node_size) {
+      if (Counted) {
+        num_too_small += n - 1 >= begin;
+      }
+      continue;
+    }
+    if (split_counter >= options.split_step) { // only split at every `split_step`th sample
+      split_counter = 0;
+    } else {
+      if (Counted) {
+        num_stepped_over += n - 1 >= begin;
+      }
+      continue;
+    }
+    if (n - 1 < begin) { // (the counters above are kept from the first sample on)
+      continue;
+    }
+    if (Counted) {
+      num_evaluated++;
+    }
+    double left_best = -INF;
+    double right_best = -INF;
+    size_t left_action = 0;
+    size_t right_action = 0;
+    const double* left_sum = sums + n * num_rewards;
+    for (size_t d = 0; d < num_rewards; d++) {
+      double left_reward = left_sum[d];
+      double right_reward = total[d] - left_reward;
+      if (left_best < left_reward) {
+        left_best = left_reward;
+        left_action = d;
       }
+      if (right_best < right_reward) {
+        right_best = right_reward;
+        right_action = d;
+      }
+    }
+    if (best.reward < left_best + right_best) {
+      best.reward = left_best + right_best;
+      best.left_reward = left_best;
+      best.right_reward = right_best;
+      best.left_action = left_action;
+      best.right_action = right_action;
+      best.split_var = p;
+      best.split_val = ranks.get_value(p, value);
+      best.position = n - 1;
+    }
+  }
+  if (Counted) {
+    add_positions(level_stats, end - begin, num_evaluated, num_too_small, num_stepped_over);
+  }
+}
+
+
+// `level_one_sweep` with the number of actions fixed at compile time if there are two or three (with
+// more actions, the unrolled loops are no faster), counted in `level_stats` (if not null)
+template <typename Ranks>
+void level_one_feature(size_t p,
+                       const SortedSets& sorted_sets,
+                       const RewardRows& rewards,
+                       const Ranks& ranks,
+                       std::vector<double>& sum_array,
+                       const SearchOptions& options,
+                       size_t begin,
+                       size_t end,
+                       LevelOneSplit& best,
+                       LevelStats* level_stats) {
+  switch (rewards.num_rewards()) {
+    case 2:
+      level_one_sweep<2, true>(p, sorted_sets, rewards, ranks, sum_array, options, begin, end, best, level_stats);
+      break;
+    case 3:
+      level_one_sweep<3, true>(p, sorted_sets, rewards, ranks, sum_array, options, begin, end, best, level_stats);
+      break;
+    default:
+      level_one_sweep<0, true>(p, sorted_sets, rewards, ranks, sum_array, options, begin, end, best, level_stats);
+  }
+}
+
+
+// Find the best depth one split along every feature, with `NumRewards` actions (see `level_one_sweep`),
+// counted in `level_stats` (if not null)
+template <size_t NumRewards, typename Ranks>
+void level_one_search(const SortedSets& sorted_sets,
+                      const RewardRows& rewards,
+                      const Ranks& ranks,
+                      std::vector<double>& sum_array,
+                      const SearchOptions& options,
+                      LevelOneSplit& best,
+                      LevelStats* level_stats) {
+  for (size_t p = 0; p < ranks.num_features(); p++) {
+    if (level_stats != nullptr) {
+      level_one_sweep<NumRewards, true>(p, sorted_sets, rewards, ranks, sum_array, options,
+                                        0, sorted_sets.size() - 1, best, level_stats);
+    } else {
+      level_one_sweep<NumRewards, false>(p, sorted_sets, rewards, ranks, sum_array, options,
+                                         0, sorted_sets.size() - 1, best, nullptr);
     }
-    res.push_back(setj);
   }
-
-  return res;
 }
 
 
-// Find the best action in a leaf node (O(nd))
-std::unique_ptr<Node> level_zero_learning(const std::vector<flat_set>& sorted_sets,
-                                          const Data* data) {
-  size_t num_rewards = data->num_rewards();
-  size_t best_action = 0;
-  double best_reward = -INF;
-
-  std::vector<double> reward_sum(num_rewards, 0.0);
-
-  for (size_t d = 0; d < num_rewards; d++) {
-    for (const auto& point : sorted_sets[0]) {
-      reward_sum[d] += point.get_reward(d);
-    }
-    if (reward_sum[d] > best_reward) {
-      best_reward = reward_sum[d];
-      best_action = d;
+// Write the best depth one split as a depth one flat tree (a leaf if no valid split was found)
+void level_one_tree(const LevelOneSplit& best,
+                    const SortedSets& sorted_sets,
+                    const RewardRows& rewards,
+                    Workspace& workspace,
+                    FlatNode* tree) {
+  if (best.reward > -INF) {
+    // "pruning": if both actions are the same then treat this as a leaf node
+    if (best.left_action == best.right_action) {
+      set_leaf(tree, best.reward, best.left_action);
+    } else {
+      set_split(tree, best.split_var, best.split_val, best.reward);
+      set_leaf(tree + 1, best.left_reward, best.left_action);
+      set_leaf(tree + 2, best.right_reward, best.right_action);
+    }
+  } else {
+    level_zero_learning(sorted_sets, rewards, workspace, tree);
+  }
+}
+
+
+// Find the best action (left and right) in the parent of a leaf node (O(npd))
+template <typename Ranks>
+void level_one_learning(const SortedSets& sorted_sets,
+                        const RewardRows& rewards,
+                        const Ranks& ranks,
+                        Workspace& workspace,
+                        const SearchOptions& options,
+                        FlatNode* tree) {
+  LevelOneSplit best;
+  LevelStats* level_stats = workspace.level_stats(1);
+  switch (rewards.num_rewards()) {
+    case 2:
+      level_one_search<2>(sorted_sets, rewards, ranks, workspace.sum_array, options, best, level_stats);
+      break;
+    case 3:
+      level_one_search<3>(sorted_sets, rewards, ranks, workspace.sum_array, options, best, level_stats);
+      break;
+    default:
+      level_one_search<0>(sorted_sets, rewards, ranks, workspace.sum_array, options, best, level_stats);
+  }
+
+  level_one_tree(best, sorted_sets, rewards, workspace, tree);
+}
+
+
+/**
+ * `level_one_learning`, looked up in (or added to) the thread's cache of depth one subtrees.
+ *
+ * The key of a node is its size and the ranks of its first and last sample along every feature
+ * (O(p) to compute, against O(npd) for the search): the node is the set of the search's samples in this
+ * box (see `SubproblemCache`). The depth one subtree of a node does not depend on the threshold
+ * it is searched with, so a cached subtree is the subtree the search would find.
+ */
+template <typename Ranks>
+void cached_level_one_learning(const SortedSets& sorted_sets,
+                               const RewardRows& rewards,
+                               const Ranks& ranks,
+                               Workspace& workspace,
+                               const SearchOptions& options,
+                               FlatNode* tree) {
+  SubproblemCache<LevelOneTree>& cache = workspace.level_one_cache;
+  if (!cache.enabled()) {
+    level_one_learning(sorted_sets, rewards, ranks, workspace, options, tree);
+    return;
+  }
+
+  uint32_t* key = cache.key();
+  size_t num_points = sorted_sets.size();
+  key[0] = static_cast<uint32_t>(num_points);
+  for (size_t j = 0; j < ranks.num_features(); j++) {
+    key[2 * j + 1] = ranks.get(sorted_sets.begin(j)[0], j);
+    key[2 * j + 2] = ranks.get(sorted_sets.begin(j)[num_points - 1], j);
+  }
+  const LevelOneTree* cached = cache.find();
+  if (cached != nullptr) {
+    std::copy(cached->nodes, cached->nodes + 3, tree);
+    workspace.stats.num_cache_hits++;
+  } else {
+    level_one_learning(sorted_sets, rewards, ranks, workspace, options, tree);
+    LevelOneTree result;
+    std::copy(tree, tree + 3, result.nodes);
+    cache.insert(result);
+    workspace.stats.num_cache_misses++;
+  }
+}
+
+
+template <typename Ranks>
+void find_best_split(const SortedSets& sorted_sets,
+                     int level,
+                     const SearchOptions& options,
+                     const RewardRows& rewards,
+                     const Ranks& ranks,
+                     double threshold,
+                     Workspace& workspace,
+                     FlatNode* tree);
+
+
+// The sum of the largest reward of every sample in a node: no tree on the node has a larger reward
+double reward_bound(const SortedSets& sorted_sets, const RewardRows& rewards) {
+  double bound = 0;
+  for (const uint32_t* it = sorted_sets.begin(0); it != sorted_sets.end(0); ++it) {
+    bound += rewards.max_reward(*it);
+  }
+
+  return bound;
+}
+
+
+// Write the best action of a node with reward sums `total` as a leaf (as `level_zero_learning` does)
+void total_leaf(const std::vector<double>& total, FlatNode* tree) {
+  size_t best_action = 0;
+  double best_reward = -INF;
+  for (size_t d = 0; d < total.size(); d++) {
+    if (total[d] > best_reward) {
+      best_reward = total[d];
+      best_action = d;
+    }
+  }
+
+  set_leaf(tree, best_reward, best_action);
+}
+
+
+/**
+ * Find the best depth one subtree of a child of a level two split candidate from the per rank sums
+ * in `buckets` (those of the left child if `Left`, otherwise those of the node minus those of the
+ * left child), with the child's reward sums in `buckets.child_total`.
+ *
+ * This is `level_one_learning` with the prefix sums taken over the ranks of each feature instead of
+ * over the child's samples: the ranks are swept in increasing order, skipping those without samples in
+ * the child, with the same split conditions, so the same subtree is found (O(d * number of ranks)).
+ * If `Counted`, the positions are added to `level_stats` as the sample sweeps count them. The number
+ * of actions is `NumRewards`, or `rewards.num_rewards()` if it is 0 (see `level_one_sweep`).
+ */
+template <bool Left, size_t NumRewards, bool Counted, typename Ranks>
+void level_two_child(const SearchOptions& options,
+                     const Ranks& ranks,
+                     const RewardRows& rewards,
+                     size_t child_size,
+                     LevelTwoWorkspace& buckets,
+                     FlatNode* tree,
+                     LevelStats* level_stats) {
+  ScopedTimer timer(Counted ? &level_stats->seconds : nullptr);
+  size_t num_rewards = NumRewards > 0 ? NumRewards : rewards.num_rewards();
+  const double* total = buckets.child_total.data();
+  double* sum = buckets.child_sum.data();
+  LevelOneSplit best;
+  // (a position between two samples that share a rank is a tie)
+  size_t num_positions = 0, num_too_small = 0, num_stepped_over = 0, num_evaluated = 0;
+  for (size_t q = 0; q < ranks.num_features(); q++) {
+    std::fill(sum, sum + num_rewards, 0.0);
+    int split_counter = 0;
+    size_t samples_counter = 0;
+    // the last rank (row) with samples in the child, if any
+    size_t previous = buckets.offsets[q + 1];
+    for (size_t r = buckets.offsets[q]; r < buckets.offsets[q + 1]; r++) {
+      size_t count = Left ? buckets.left_counts[r] : buckets.node_counts[r] - buckets.left_counts[r];
+      if (count == 0) {
+        continue;
+      }
+      if (Counted) {
+        num_positions += count - (previous < r ? 0 : 1);
+      }
+      // the samples with ranks up to `previous` go left
+      if (previous < r) {
+        if (samples_counter < options.min_node_size || child_size - samples_counter < options.min_node_size) {
+          if (Counted) {
+            num_too_small++;
+          }
+        } else if (split_counter < options.split_step) {
+          if (Counted) {
+            num_stepped_over++;
+          }
+        } else {
+          split_counter = 0;
+          if (Counted) {
+            num_evaluated++;
+          }
+          double left_best = -INF;
+          double right_best = -INF;
+          size_t left_action = 0;
+          size_t right_action = 0;
+          for (size_t d = 0; d < num_rewards; d++) {
+            double left_reward = sum[d];
+            double right_reward = total[d] - left_reward;
+            if (left_best < left_reward) {
+              left_best = left_reward;
+              left_action = d;
+            }
+            if (right_best < right_reward) {
+              right_best = right_reward;
+              right_action = d;
+            }
+          }
+          if (best.reward < left_best + right_best) {
+            best.reward = left_best + right_best;
+            best.left_reward = left_best;
+            best.right_reward = right_best;
+            best.left_action = left_action;
+            best.right_action = right_action;
+            best.split_var = q;
+            best.split_val = ranks.get_value(q, static_cast<uint32_t>(previous - buckets.offsets[q]));
+          }
+        }
+      }
+      split_counter += static_cast<int>(count);
+      samples_counter += count;
+      const double* left_row = buckets.left_sums.data() + r * num_rewards;
+      const double* node_row = buckets.node_sums.data() + r * num_rewards;
+      for (size_t d = 0; d < num_rewards; d++) {
+        sum[d] += Left ? left_row[d] : node_row[d] - left_row[d];
+      }
+      previous = r;
+    }
+  }
+  if (Counted) {
+    level_stats->num_nodes++;
+    add_positions(level_stats, num_positions, num_evaluated, num_too_small, num_stepped_over);
+  }
+
+  if (best.reward == -INF) {
+    total_leaf(buckets.child_total, tree);
+  } else if (best.left_action == best.right_action) {
+    set_leaf(tree, best.reward, best.left_action);
+  } else {
+    set_split(tree, best.split_var, best.split_val, best.reward);
+    set_leaf(tree + 1, best.left_reward, best.left_action);
+    set_leaf(tree + 2, best.right_reward, best.right_action);
+  }
+}
+
+
+// `level_two_child`, counted in `level_stats` if it is not null
+template <bool Left, size_t NumRewards, typename Ranks>
+void level_two_child_counted(const SearchOptions& options,
+                             const Ranks& ranks,
+                             const RewardRows& rewards,
+                             size_t child_size,
+                             LevelTwoWorkspace& buckets,
+                             FlatNode* tree,
+                             LevelStats* level_stats) {
+  if (level_stats != nullptr) {
+    level_two_child<Left, NumRewards, true>(options, ranks, rewards, child_size, buckets, tree, level_stats);
+  } else {
+    level_two_child<Left, NumRewards, false>(options, ranks, rewards, child_size, buckets, tree, nullptr);
+  }
+}
+
+
+// Whether `level_two_feature` is used at a level two node: its passes over the ranks of every
+// feature cost less than the children's passes over the samples of every feature
+bool use_level_two(const LevelTwoWorkspace& buckets, const SortedSets& sorted_sets, size_t num_features) {
+  return buckets.num_values > 0 && buckets.num_values <= num_features * sorted_sets.size();
+}
+
+
+/**
+ * Sum up the rewards and counts of the samples in `sorted_sets` (a level two node) by rank of every
+ * feature, and in all, into `buckets` (O(pnd)). The sweeps along every feature of the node share these.
+ */
+template <typename Ranks>
+void level_two_node(const SortedSets& sorted_sets,
+                    const RewardRows& rewards,
+                    const Ranks& ranks,
+                    LevelTwoWorkspace& buckets) {
+  size_t num_points = sorted_sets.size();
+  size_t num_features = ranks.num_features();
+  size_t num_rewards = rewards.num_rewards();
+  const uint32_t* setp = sorted_sets.begin(0);
+  const uint32_t* counts = rewards.get_counts();
+  std::fill(buckets.node_sums.begin(), buckets.node_sums.end(), 0.0);
+  std::fill(buckets.node_counts.begin(), buckets.node_counts.end(), 0);
+  std::fill(buckets.node_total.begin(), buckets.node_total.end(), 0.0);
+  buckets.node_size = 0;
+  for (size_t n = 0; n < num_points; n++) {
+    uint32_t sample = setp[n];
+    size_t count = counts == nullptr ? 1 : counts[sample];
+    const double* sample_rewards = rewards.get(sample);
+    for (size_t j = 0; j < num_features; j++) {
+      size_t row = buckets.offsets[j] + ranks.get(sample, j);
+      double* sum = buckets.node_sums.data() + row * num_rewards;
+      for (size_t d = 0; d < num_rewards; d++) {
+        sum[d] += sample_rewards[d];
+      }
+      buckets.node_counts[row] += count;
+    }
+    for (size_t d = 0; d < num_rewards; d++) {
+      buckets.node_total[d] += sample_rewards[d];
+    }
+    buckets.node_size += count;
+  }
+}
+
+
+/**
+ * `find_best_split_feature` at a level two node, without materializing the children.
+ *
+ * As the sweep along feature p moves samples to the left child, it adds their rewards and counts to the
+ * sums of their rank along every feature (O(pd) per sample). The right child's sums are the node's minus
+ * the left child's, so the best depth one subtree of both children of a candidate are found by passes
+ * over the ranks (see `level_two_child`), instead of by partitioning the node's sorted sets and passing
+ * over the children's samples along every feature (O(pnd) per candidate). The children are pruned
+ * with the same bounds as `find_best_split`, and the candidates compared in the same order. If the
+ * sums are exact (see `RewardRows::exact_sums`), every reward equals the one the passes over the
+ * samples compute, so the same tree is found. Otherwise the sweep adds the rewards up in a different
+ * order than those passes, so its rewards may differ from theirs by rounding (within
+ * 2 * `bound_slack()`), and it only screens the candidates: one whose reward is below the incumbent
+ * by more than that can not be selected, and the children of the others are searched over their
+ * samples as in `find_best_split_feature`, so the same tree is found here too. The node's sums are
+ * those of `level_two_node`, computed once for all features. The number of actions is `NumRewards`,
+ * or `rewards.num_rewards()` if it is 0.
+ */
+template <size_t NumRewards, typename Ranks>
+void level_two_feature(size_t p,
+                       const SortedSets& sorted_sets,
+                       const SearchOptions& options,
+                       const RewardRows& rewards,
+                       const Ranks& ranks,
+                       double node_bound,
+                       double threshold,
+                       size_t begin,
+                       size_t end,
+                       Workspace& workspace,
+                       Split& best) {
+  size_t num_features = ranks.num_features();
+  size_t num_rewards = NumRewards > 0 ? NumRewards : rewards.num_rewards();
+  const uint32_t* setp = sorted_sets.begin(p);
+  const uint32_t* counts = rewards.get_counts();
+  LevelTwoWorkspace& buckets = workspace.level_two;
+  FlatNode* candidate = workspace.levels[2].candidate.data();
+  FlatNode* left_tree = candidate + 1;
+  FlatNode* right_tree = candidate + flat_tree_size(1) + 1;
+
+  SearchMonitor* monitor = workspace.monitor;
+  bool is_root = monitor != nullptr && monitor->get_root_level() == 2;
+  size_t num_advanced = begin;
+  SharedIncumbent* shared = workspace.root_level == 2 ? workspace.root_incumbent : nullptr;
+  LevelStats* child_stats = workspace.level_stats(1);
+  // (without exact sums, the children of the candidates that are not screened out are searched again
+  // over their samples, and only those searches are counted)
+  LevelStats* sweep_stats = rewards.exact_sums() ? child_stats : nullptr;
+
+  size_t node_size = buckets.node_size;
+  // (the left child starts out empty)
+  std::fill(buckets.left_sums.begin(), buckets.left_sums.end(), 0.0);
+  std::fill(buckets.left_counts.begin(), buckets.left_counts.end(), 0);
+  std::fill(buckets.left_total.begin(), buckets.left_total.end(), 0.0);
+
+  // the reward bound of the samples that go left, kept by the sweep
+  double left_bound = 0;
+  int split_counter = 0;
+  size_t samples_counter = 0;
+  // (the positions before `begin` are not counted)
+  size_t num_too_small = 0, num_stepped_over = 0, num_evaluated = 0, num_partitioned = 0;
+  auto add_counts = [&](size_t num_positions) {
+    LevelStats* level_stats = workspace.level_stats(2);
+    add_positions(level_stats, num_positions, num_evaluated, num_too_small, num_stepped_over);
+    if (level_stats != nullptr) {
+      level_stats->num_partitioned += num_partitioned;
+    }
+  };
+  for (size_t n = 0; n < end; n++) {
+    // samples 0, ..., n along feature p go left
+    uint32_t sample = setp[n];
+    uint32_t value = ranks.get(sample, p);
+    size_t count = counts == nullptr ? 1 : counts[sample];
+    const double* sample_rewards = rewards.get(sample);
+    for (size_t j = 0; j < num_features; j++) {
+      size_t row = buckets.offsets[j] + ranks.get(sample, j);
+      double* sum = buckets.left_sums.data() + row * num_rewards;
+      for (size_t d = 0; d < num_rewards; d++) {
+        sum[d] += sample_rewards[d];
+      }
+      buckets.left_counts[row] += count;
+    }
+    for (size_t d = 0; d < num_rewards; d++) {
+      buckets.left_total[d] += sample_rewards[d];
+    }
+    left_bound += rewards.max_reward(sample);
+    split_counter += static_cast<int>(count);
+    samples_counter += count;
+    if (value >= ranks.get(setp[n + 1], p)) { // are the values the same then skip
+      continue;
+    }
+    if (samples_counter < options.min_node_size || node_size - samples_counter < options.min_node_size) {
+      num_too_small += n >= begin;
+      continue;
+    }
+    if (split_counter >= options.split_step) { // only split at every `split_step`th sample
+      split_counter = 0;
+    } else {
+      num_stepped_over += n >= begin;
+      continue;
+    }
+    if (n < begin) { // (the counters above are kept from the first sample on)
+      continue;
+    }
+    if (monitor != nullptr && monitor->is_cancelled()) {
+      add_counts(n - begin);
+      return;
+    }
+    num_evaluated++;
+    double incumbent = -INF;
+    if (options.bound_pruning) {
+      incumbent = best.found ? std::max(threshold, best.tree[0].reward) : threshold;
+      if (shared != nullptr) {
+        incumbent = std::max(incumbent, shared->get());
+      }
+    }
+    double right_bound = node_bound - left_bound;
+    double left_threshold = incumbent - right_bound;
+    buckets.child_total = buckets.left_total;
+    if (left_threshold > -INF && left_bound + rewards.bound_slack() < left_threshold) {
+      workspace.stats.num_pruned++;
+      count_pruned(sweep_stats);
+      total_leaf(buckets.child_total, left_tree);
+    } else {
+      level_two_child_counted<true, NumRewards>(options, ranks, rewards, samples_counter, buckets, left_tree,
+                                                sweep_stats);
+    }
+    double right_threshold = incumbent - left_tree->reward;
+    for (size_t d = 0; d < num_rewards; d++) {
+      buckets.child_total[d] = buckets.node_total[d] - buckets.left_total[d];
+    }
+    if (right_threshold > -INF && right_bound + rewards.bound_slack() < right_threshold) {
+      workspace.stats.num_pruned++;
+      count_pruned(sweep_stats);
+      total_leaf(buckets.child_total, right_tree);
+    } else {
+      level_two_child_counted<false, NumRewards>(options, ranks, rewards, node_size - samples_counter, buckets,
+                                                 right_tree, sweep_stats);
+    }
+    workspace.stats.num_subtrees += 2;
+    double reward = left_tree->reward + right_tree->reward;
+    bool screened = false;
+    if (!rewards.exact_sums()) {
+      if (best.found && reward + 2 * rewards.bound_slack() < std::max(incumbent, best.tree[0].reward)) {
+        // the candidate's exact reward is below the incumbent too
+        screened = true;
+        workspace.stats.num_pruned += 2;
+        count_pruned(child_stats);
+        count_pruned(child_stats);
+      } else {
+        // search the children as `find_best_split_feature` does
+        uint32_t* children = workspace.levels[2].children.data();
+        SortedSets left_sorted_sets(children, n + 1);
+        SortedSets right_sorted_sets(children + num_features * (n + 1), sorted_sets.size() - n - 1);
+        partition_sorted_sets(sorted_sets, p, ranks, left_sorted_sets, right_sorted_sets);
+        num_partitioned += num_features * sorted_sets.size();
+        find_best_split(left_sorted_sets, 1, options, rewards, ranks, left_threshold, workspace, left_tree);
+        find_best_split(right_sorted_sets, 1, options, rewards, ranks, incumbent - left_tree->reward,
+                        workspace, right_tree);
+        reward = left_tree->reward + right_tree->reward;
+      }
+    }
+    if (!screened && (!best.found || reward > best.tree[0].reward)) {
+      set_split(candidate, p, ranks.get_value(p, value), reward);
+      std::copy(candidate, candidate + flat_tree_size(2), best.tree.begin());
+      best.found = true;
+      best.position = n;
+      if (shared != nullptr) {
+        shared->update(reward);
+      }
+    }
+    if (is_root) {
+      monitor->update_best(reward);
+      monitor->advance(n + 1 - num_advanced);
+      num_advanced = n + 1;
+    }
+  }
+  add_counts(end - begin);
+  if (is_root) {
+    monitor->advance(end - num_advanced);
+  }
+}
+
+
+/**
+ * Find the best split along feature p at a level >= 2 node, at positions `begin` <= k < `end`
+ * (<= N - 1), updating `best` if it is improved upon.
+ *
+ * With bound pruning, the subtrees of a candidate are searched with the reward they need to make
+ * the candidate beat the incumbent (the best split so far, or `threshold` if larger): the left
+ * subtree needs more than incumbent - (bound of the right child), and once it is known, the right
+ * subtree needs more than incumbent - (reward of the left subtree).
+ */
+template <typename Ranks>
+void find_best_split_feature(size_t p,
+                             const SortedSets& sorted_sets,
+                             int level,
+                             const SearchOptions& options,
+                             const RewardRows& rewards,
+                             const Ranks& ranks,
+                             double node_bound,
+                             double threshold,
+                             size_t begin,
+                             size_t end,
+                             Workspace& workspace,
+                             Split& best) {
+  if (level == 2 && use_level_two(workspace.level_two, sorted_sets, ranks.num_features())) {
+    // (with the number of actions fixed at compile time as in `level_one_feature`)
+    switch (rewards.num_rewards()) {
+      case 2:
+        level_two_feature<2>(p, sorted_sets, options, rewards, ranks, node_bound, threshold, begin, end,
+                              workspace, best);
+        break;
+      case 3:
+        level_two_feature<3>(p, sorted_sets, options, rewards, ranks, node_bound, threshold, begin, end,
+                              workspace, best);
+        break;
+      default:
+        level_two_feature<0>(p, sorted_sets, options, rewards, ranks, node_bound, threshold, begin, end,
+                              workspace, best);
     }
+    return;
   }
+  size_t num_points = sorted_sets.size();
+  size_t num_features = ranks.num_features();
+  const uint32_t* setp = sorted_sets.begin(p);
+  LevelWorkspace& level_workspace = workspace.levels[level];
+  FlatNode* candidate = level_workspace.candidate.data();
+  FlatNode* left_tree = candidate + 1;
+  FlatNode* right_tree = candidate + flat_tree_size(level - 1) + 1;
 
-  return std::unique_ptr<Node> (new Node(0, 0.0, best_reward, best_action));
-}
-
+  SearchMonitor* monitor = workspace.monitor;
+  bool is_root = monitor != nullptr && level == monitor->get_root_level();
+  size_t num_advanced = begin;
+  SharedIncumbent* shared = level == workspace.root_level ? workspace.root_incumbent : nullptr;
 
-// Find the best action (left and right) in the parent of a leaf node (O(npd))
-std::unique_ptr<Node> level_one_learning(const std::vector<flat_set>& sorted_sets,
-                                         const Data* data,
-                                         std::vector<std::vector<double>>& sum_array,
-                                         int split_step,
-                                         size_t min_node_size) {
-  size_t num_points = sorted_sets[0].size();
-  size_t num_rewards = data->num_rewards();
-  size_t num_features = data->num_features();
-
-  size_t best_action_left = 0;
-  size_t best_action_right = 0;
-  double split_val = 0.0;
-  size_t split_var = 0;
-  double best_reward = -INF;
-  double global_best_left = -INF;
-  double global_best_right = -INF;
+  const uint32_t* counts = rewards.get_counts();
+  size_t node_size = num_points;
+  if (counts != nullptr) {
+    node_size = 0;
+    for (size_t n = 0; n < num_points; n++) {
+      node_size += counts[setp[n]];
+    }
+  }
 
-  for (size_t p = 0; p < num_features; p++) {
-    // Fill the reward matrix with cumulative sums
-    for (size_t d = 0; d < num_rewards; d++) {
-      size_t n = 0;
-      for (const auto &point : sorted_sets[p]) {
-        ++n;
-        sum_array[d][n] = sum_array[d][n - 1] + point.get_reward(d);
-      }
+  // the reward bound of the samples that go left, kept by the sweep
+  double left_bound = 0;
+  int split_counter = 0;
+  size_t samples_counter = 0;
+  // (the positions before `begin` are not counted, and each candidate partitions the node's sorted
+  // sets into those of its children)
+  size_t num_too_small = 0, num_stepped_over = 0, num_evaluated = 0;
+  auto add_counts = [&](size_t num_positions) {
+    LevelStats* level_stats = workspace.level_stats(level);
+    add_positions(level_stats, num_positions, num_evaluated, num_too_small, num_stepped_over);
+    if (level_stats != nullptr) {
+      level_stats->num_partitioned += num_evaluated * num_features * num_points;
     }
-    auto it = sorted_sets[p].cbegin();
-    int split_counter = 0;
-    size_t samples_counter = 0;
-    size_t n = 0;
-    for (;;) {
-      ++n;
-      auto value = it->get_value(p);
-      ++it;
-      if (it == sorted_sets[p].end()) {
-        break;
-      }
-      auto next_value = it->get_value(p);
-      split_counter += 1;
-      samples_counter += 1;
-      if (value == next_value) {
-        continue;
-      }
-      if (samples_counter < min_node_size || num_points - samples_counter < min_node_size) {
-        continue;
-      }
-      if (split_counter >= split_step) { // only split at every `split_step`th sample
-        split_counter = 0;
-      } else {
-        continue;
-      }
-      double left_best = -INF;
-      double right_best = -INF;
-      size_t left_action = 0;
-      size_t right_action = 0;
-      for (size_t d = 0; d < num_rewards; d++) {
-        double left_reward = sum_array[d][n];
-        double right_reward = sum_array[d][num_points] - left_reward;
-        if (left_best < left_reward) {
-          left_best = left_reward;
-          left_action = d;
-        }
-        if (right_best < right_reward) {
-          right_best = right_reward;
-          right_action = d;
-        }
+  };
+  for (size_t n = 0; n < end; n++) {
+    // samples 0, ..., n along feature p go left
+    uint32_t value = ranks.get(setp[n], p);
+    left_bound += rewards.max_reward(setp[n]);
+    uint32_t count = counts == nullptr ? 1 : counts[setp[n]];
+    split_counter += count;
+    samples_counter += count;
+    if (value >= ranks.get(setp[n + 1], p)) { // are the values the same then skip
+      continue;
+    }
+    if (samples_counter < options.min_node_size || node_size - samples_counter < options.min_node_size) {
+      num_too_small += n >= begin;
+      continue;
+    }
+    if (split_counter >= options.split_step) { // only split at every `split_step`th sample
+      split_counter = 0;
+    } else {
+      num_stepped_over += n >= begin;
+      continue;
+    }
+    if (n < begin) { // (the counters above are kept from the first sample on)
+      continue;
+    }
+    if (monitor != nullptr && monitor->is_cancelled()) {
+      add_counts(n - begin);
+      return;
+    }
+    num_evaluated++;
+    uint32_t* children = level_workspace.children.data();
+    SortedSets left_sorted_sets(children, n + 1);
+    SortedSets right_sorted_sets(children + num_features * (n + 1), num_points - n - 1);
+    partition_sorted_sets(sorted_sets, p, ranks, left_sorted_sets, right_sorted_sets);
+    double incumbent = -INF;
+    if (options.bound_pruning) {
+      incumbent = best.found ? std::max(threshold, best.tree[0].reward) : threshold;
+      if (shared != nullptr) {
+        incumbent = std::max(incumbent, shared->get());
       }
-      if (best_reward < left_best + right_best) {
-        best_reward = left_best + right_best;
-        global_best_left = left_best;
-        global_best_right = right_best;
-        best_action_left = left_action;
-        best_action_right = right_action;
-        split_var = p;
-        split_val = value;
+    }
+    double right_bound = node_bound - left_bound;
+    find_best_split(left_sorted_sets, level - 1, options, rewards, ranks,
+                    incumbent - right_bound, workspace, left_tree);
+    find_best_split(right_sorted_sets, level - 1, options, rewards, ranks,
+                    incumbent - left_tree->reward, workspace, right_tree);
+    workspace.stats.num_subtrees += 2;
+    double reward = left_tree->reward + right_tree->reward;
+    if (!best.found || reward > best.tree[0].reward) {
+      set_split(candidate, p, ranks.get_value(p, value), reward);
+      std::copy(candidate, candidate + flat_tree_size(level), best.tree.begin());
+      best.found = true;
+      best.position = n;
+      if (shared != nullptr) {
+        shared->update(reward);
       }
     }
+    if (is_root) {
+      monitor->update_best(reward);
+      monitor->advance(n + 1 - num_advanced);
+      num_advanced = n + 1;
+    }
   }
-  if (best_reward > -INF) {
-    // "pruning": if both actions are the same then treat this as a leaf node
-    if (best_action_left == best_action_right) {
-      return std::unique_ptr<Node> (new Node(0, 0.0, best_reward, best_action_left));
+  add_counts(end - begin);
+  if (is_root) {
+    monitor->advance(end - num_advanced);
+  }
+}
+
+
+// Write the best level >= 2 split as a depth `level` flat tree (a leaf if no valid split was found)
+void split_tree(const Split& best,
+                int level,
+                const SortedSets& sorted_sets,
+                const RewardRows& rewards,
+                Workspace& workspace,
+                FlatNode* tree) {
+  if (!best.found) {
+    level_zero_learning(sorted_sets, rewards, workspace, tree);
+  } else {
+    const FlatNode* left_child = &best.tree[1];
+    const FlatNode* right_child = &best.tree[flat_tree_size(level - 1) + 1];
+        // "pruning", the recursive case (same action in both leaves):
+    if ((left_child->is_leaf && right_child->is_leaf) &&
+            (left_child->action_id == right_child->action_id)) {
+      double leaf_reward = left_child->reward + right_child->reward;
+      size_t leaf_action = left_child->action_id;
+      set_leaf(tree, leaf_reward, leaf_action);
     } else {
-      auto left = std::unique_ptr<Node> (new Node(0, 0.0, global_best_left, best_action_left));
-      auto right = std::unique_ptr<Node> (new Node(0, 0.0, global_best_right, best_action_right));
-      auto ans = std::unique_ptr<Node> (new Node(split_var, split_val, best_reward, 0));
-      ans->left_child = std::move(left);
-      ans->right_child = std::move(right);
-      return ans;
+      std::copy(best.tree.begin(), best.tree.end(), tree);
     }
-  } else {
-    return level_zero_learning(sorted_sets, data);
   }
 }
 
@@ -232,7 +1708,7 @@ std::unique_ptr<Node> level_one_learning(const std::vector<flat_set>& sorted_set
  *    +     +
  *    A     B
  *
- * The actions are column indices of the reward matrix in data.
+ * The actions are column indices of the reward matrix.
  *
  * @param sorted_sets: A vector of sorted sets
  * @param level: The tree depth
@@ -240,127 +1716,899 @@ std::unique_ptr<Node> level_one_learning(const std::vector<flat_set>& sorted_set
  *  performing tree search. split_step = 1 considers every possible split, split_step = 10
  *  considers splitting at every 10'th sample and may give a substantial speedup on dense features.
  * @param min_node_size An integer indicating the smallest terminal node size permitted.
- * @param data: The data class
- * @param sum_array: A global zero initialized (num_rewards) x (num_points + 1)
- *  array which is used to calculate cumulative rewards.
- * @return The best tree
+ * @param rewards: The rewards
+ * @param ranks: The rank of every sample along every feature.
+ * @param threshold: The reward a tree must exceed to matter to the caller (-INF if any tree does).
+ *  If the best tree's reward is below it, any tree with a reward below it may be returned instead.
+ * @param workspace: The preallocated scratch memory of this thread.
+ * @param tree: The buffer (of size flat_tree_size(level)) the best tree is written to.
  *
  * Details:
  * This algorithm maintains the data structure sorted_sets to quickly obtain
  * the sort order of points along all dimensions p for a given split.
  *
- * For each p * (N - 1) possible splits, for each dimension d:
- *   All points on the right side are stored in right_sorted_sets[d]
- *   All points on the left side are stored in left_sorted_sets[d]
- *   For each split candidate, the point is moved from the right set to the left
- *   set for all dimensions.
+ * For each p * (N - 1) possible splits:
+ *   Along dimension p, the first samples in sorted_sets go left and the rest go right.
+ *   At a valid split candidate, the sets of both children are materialized by a stable
+ *   partition (O(p N), no comparisons) into left_sorted_sets and right_sorted_sets,
+ *   which keeps every dimension sorted.
  *   This proceeds recursively to enumerate the reward in all
  *   possible split.
  *
  * The split condition reads: if value <= split value, go to left, else right.
  *
- * Time complexity (k >= 1): O(p^k n^k (log n + d) + pnlog n) where p is the number of
+ * With bound pruning (options.bound_pruning), the search is a branch-and-bound: a subtree
+ * whose reward bound (the sum of its samples' largest rewards) is below the reward it needs
+ * to beat the best split found so far is not searched. A split only replaces the incumbent if
+ * it is strictly better, so the pruned trees could never have been selected and the
+ * result (including how ties are broken) is identical to exhaustive search. (The level two
+ * sweep, see `level_two_feature`, computes the same rewards as the exhaustive passes over the
+ * samples where its sums are exact, and otherwise only skips candidates that can not be selected.)
+ *
+ * Time complexity (k >= 1): O(p^k n^k d + pnlog n) where p is the number of
  * features, n the number of observations, d the number of actions, and k
  * the tree depth.
  */
-std::unique_ptr<Node> find_best_split(const std::vector<flat_set>& sorted_sets,
-                                      int level,
-                                      int split_step,
-                                      size_t min_node_size,
-                                      const Data* data,
-                                      std::vector<std::vector<double>>& sum_array) {
-  if (level == 0) {
+template <typename Ranks>
+void find_best_split(const SortedSets& sorted_sets,
+                     int level,
+                     const SearchOptions& options,
+                     const RewardRows& rewards,
+                     const Ranks& ranks,
+                     double threshold,
+                     Workspace& workspace,
+                     FlatNode* tree) {
+  LevelStats* level_stats = workspace.level_stats(level);
+  ScopedTimer timer(level_stats != nullptr ? &level_stats->seconds : nullptr);
+  if (level_stats != nullptr) {
+    level_stats->num_nodes++;
+  }
+  if (threshold > -INF && level > 0 &&
+      reward_bound(sorted_sets, rewards) + rewards.bound_slack() < threshold) {
+    // no tree on these samples has enough reward to matter: stop with a leaf (that also doesn't)
+    workspace.stats.num_pruned++;
+    if (level_stats != nullptr) {
+      level_stats->num_pruned++;
+    }
+    level_zero_learning(sorted_sets, rewards, workspace, tree);
+  } else if (level == 0) {
     // this base case will only be hit if `find_best_split` is called directly with level = 0
-    return level_zero_learning(sorted_sets, data);
+    level_zero_learning(sorted_sets, rewards, workspace, tree);
   } else if (level == 1) {
     // if at the parent of a leaf node we can compute the optimal action for both leaves
-    return level_one_learning(sorted_sets, data, sum_array, split_step, min_node_size);
+    cached_level_one_learning(sorted_sets, rewards, ranks, workspace, options, tree);
   // else continue the recursion
   } else {
-    size_t num_points = sorted_sets[0].size();
-    size_t num_features = data->num_features();
-    size_t best_split_var;
-    double best_split_val;
-    std::unique_ptr<Node> best_left_child = nullptr;
-    std::unique_ptr<Node> best_right_child = nullptr;
-    std::unique_ptr<Node> best_ans_as_leaf = nullptr;
+    double node_bound = reward_bound(sorted_sets, rewards);
+    Split& best = workspace.levels[level].best;
+    best.found = false;
+    if (level == 2 && use_level_two(workspace.level_two, sorted_sets, ranks.num_features())) {
+      level_two_node(sorted_sets, rewards, ranks, workspace.level_two);
+    }
+    for (size_t p = 0; p < ranks.num_features(); p++) {
+      find_best_split_feature(p, sorted_sets, level, options, rewards, ranks, node_bound, threshold,
+                              0, sorted_sets.size() - 1, workspace, best);
+    }
+
+    split_tree(best, level, sorted_sets, rewards, workspace, tree);
+  }
+}
 
+
+// The root features of `slice` in the order they are searched: with a time or evaluation limit by
+// decreasing best depth one reward (a cheap O(pnd) proxy for the reward of the deeper trees they root,
+// so that good trees are found before the search stops), otherwise in feature order.
+template <typename Ranks>
+std::vector<size_t> root_feature_order(const SortedSets& sorted_sets,
+                                       const SearchOptions& options,
+                                       const RewardRows& rewards,
+                                       const Ranks& ranks,
+                                       const RootSlice& slice,
+                                       Workspace& workspace) {
+  size_t num_features = ranks.num_features();
+  std::vector<size_t> order = slice.features;
+  if (order.empty()) {
     for (size_t p = 0; p < num_features; p++) {
-      auto right_sorted_sets = sorted_sets; // copy operator
-      auto left_sorted_sets = create_sorted_sets(data, true); // empty
-      int split_counter = 0;
-      size_t samples_counter = 0;
-      for (size_t n = 0; n < num_points - 1; n++) {
-        auto point = right_sorted_sets[p].cbegin(); // O(1)
-        Point point_bk = *point; // store the Point instance since the iterator will be invalid after erase
-        right_sorted_sets[p].erase(point); // O(1)
-        left_sorted_sets[p].insert(point_bk); // O(log n)
-        for (size_t j = 0; j < num_features; j++) {
-          if (j == p) {
-            continue;
-          }
-          auto to_erase = right_sorted_sets[j].find(point_bk); // O(log n)
-          right_sorted_sets[j].erase(to_erase); // O(1)
-          left_sorted_sets[j].insert(point_bk); // O(log n)
-        }
-        auto next = right_sorted_sets[p].cbegin(); // O(1)
-        split_counter += 1;
-        samples_counter += 1;
-        if (point_bk.get_value(p) >= next->get_value(p)) { // are the values the same then skip
-          continue;
+      order.push_back(p);
+    }
+  }
+  for (size_t p : order) {
+    if (p >= num_features) {
+      throw std::invalid_argument("Root feature index out of range.");
+    }
+  }
+  std::sort(order.begin(), order.end());
+  order.erase(std::unique(order.begin(), order.end()), order.end());
+  if (options.time_limit <= 0 && options.max_evaluations == 0) {
+    return order;
+  }
+
+  std::vector<double> score(num_features);
+  for (size_t p : order) {
+    LevelOneSplit best;
+    level_one_feature(p, sorted_sets, rewards, ranks, workspace.sum_array, options,
+                      0, sorted_sets.size() - 1, best, nullptr);
+    score[p] = best.reward;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return score[a] > score[b]; });
+
+  return order;
+}
+
+
+#ifdef POLICYTREE_TEST_HOOKS
+std::function<void(size_t)> parallel_search_task_hook;
+#endif
+
+
+/**
+ * Run `search_task(i, workspace)` for each task i < `num_tasks` on one worker thread per workspace.
+ *
+ * Tasks are handed out to workers one at a time from a shared counter, so a thread that
+ * drew cheap tasks moves on to the next one. Each worker has its own workspace, the only mutable
+ * state used by the recursion. With a `monitor`, the calling thread reports progress while the workers run.
+ * If a task throws, the workers take no more tasks, and the first exception is rethrown on the calling
+ * thread once they have all stopped.
+ */
+template <typename SearchTask>
+void parallel_search(size_t num_tasks,
+                     std::vector<Workspace>& workspaces,
+                     SearchMonitor* monitor,
+                     const SearchTask& search_task) {
+  std::atomic<size_t> next_task(0);
+  std::atomic<size_t> num_running(workspaces.size());
+  // the first error of a task (e.g. std::bad_alloc), after which the workers stop taking tasks
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+  auto worker = [&](Workspace& workspace) {
+    for (size_t i = next_task++; i < num_tasks && !failed; i = next_task++) {
+      try {
+#ifdef POLICYTREE_TEST_HOOKS
+        if (parallel_search_task_hook) {
+          parallel_search_task_hook(i);
         }
-        if (samples_counter < min_node_size || num_points - samples_counter < min_node_size) {
-          continue;
+#endif
+        search_task(i, workspace);
+      } catch (...) {
+        if (!failed.exchange(true)) {
+          error = std::current_exception();
         }
-        if (split_counter >= split_step) { // only split at every `split_step`th sample
-          split_counter = 0;
-        } else {
-          continue;
+      }
+    }
+    num_running--;
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(workspaces.size());
+  for (auto& workspace : workspaces) {
+    threads.push_back(std::thread(worker, std::ref(workspace)));
+  }
+  if (monitor != nullptr) {
+    monitor->wait(num_running);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+
+// The root split positions `begin` <= k < `end` along a feature, searched by one thread
+struct RootTask {
+  size_t feature;
+  size_t begin;
+  size_t end;
+  // the number of split candidates (positions where the feature's value changes)
+  size_t num_candidates;
+};
+
+
+/**
+ * Divide the root split positions `begin` <= k < `end` along `features` into the tasks of a depth >= 2
+ * search on `num_threads` threads, listed by feature and position.
+ *
+ * The cost of a root feature is about its number of split candidates, which ranges from one (a binary
+ * feature) to N - 1 (a continuous one). A feature with many candidates is divided into ranges of about
+ * the same number of candidates, about 8 for each thread in all, so the threads stay busy until the end
+ * of the search. (The sweep of a range still starts at the first sample, which is O(n) against O(pn)
+ * per candidate. The level two sweep, which adds every sample before a range to the sums along every
+ * feature, is not divided.)
+ */
+template <typename Ranks>
+std::vector<RootTask> root_tasks(const SortedSets& sorted_sets,
+                                 int depth,
+                                 const Ranks& ranks,
+                                 const std::vector<size_t>& features,
+                                 size_t begin,
+                                 size_t end,
+                                 size_t num_threads,
+                                 const Workspace& workspace) {
+  std::vector<size_t> sorted_features = features;
+  std::sort(sorted_features.begin(), sorted_features.end());
+  std::vector<size_t> num_candidates(ranks.num_features(), 0);
+  size_t total = 0;
+  for (size_t p : sorted_features) {
+    const uint32_t* setp = sorted_sets.begin(p);
+    for (size_t n = begin; n < end; n++) {
+      if (ranks.get(setp[n], p) < ranks.get(setp[n + 1], p)) {
+        num_candidates[p]++;
+      }
+    }
+    total += num_candidates[p];
+  }
+  size_t chunk_size = std::max(total / (8 * num_threads), static_cast<size_t>(1));
+  if (depth == 2 && use_level_two(workspace.level_two, sorted_sets, ranks.num_features())) {
+    chunk_size = total + 1;
+  }
+
+  std::vector<RootTask> tasks;
+  for (size_t p : sorted_features) {
+    const uint32_t* setp = sorted_sets.begin(p);
+    RootTask task = {p, begin, end, 0};
+    for (size_t n = begin; n < end; n++) {
+      if (ranks.get(setp[n], p) < ranks.get(setp[n + 1], p)) {
+        task.num_candidates++;
+      }
+      // (the last range takes the rest of the candidates)
+      if (task.num_candidates == chunk_size && num_candidates[p] - task.num_candidates >= chunk_size) {
+        task.end = n + 1;
+        tasks.push_back(task);
+        num_candidates[p] -= task.num_candidates;
+        task = {p, n + 1, end, 0};
+      }
+    }
+    tasks.push_back(task);
+  }
+
+  return tasks;
+}
+
+
+/**
+ * Find the best depth `depth` tree on the samples in `sorted_sets` whose root split is in `slice`,
+ * on one thread per workspace, and describe its root split in `root` (if not null).
+ * At depth >= 2, `threshold` is as in `find_best_split` (it is ignored at depth 0 and 1).
+ *
+ * The root features (at depth >= 2, ranges of root split positions, see `root_tasks`) are searched in
+ * parallel, with the best split of each stored separately. Reducing these in feature (and position)
+ * order with the same strict comparison as the sequential search breaks ties identically (the first
+ * feature wins), regardless of the number of threads: every task computes the rewards of its
+ * candidates exactly as the sequential search does. (With bound pruning the threads prune against
+ * the best root split any of them has found so far, a `SharedIncumbent`: a tree that ties with it is
+ * still not pruned, so this does not change the result either.)
+ * A slice only skips the evaluation of root split candidates: the sweeps still start at the first
+ * sample, so a slice sees the same candidates (and `split_step` grid) as the full search.
+ *
+ * With a `monitor`, progress is counted in root split positions. If the search is cancelled (or
+ * stops at a limit), `tree` is the best tree among the candidates searched before it stopped.
+ * With a limit, the root features are searched in the order given by `root_feature_order`.
+ */
+template <typename Ranks>
+void search_tree(const SortedSets& sorted_sets,
+                 int depth,
+                 const SearchOptions& options,
+                 const RewardRows& rewards,
+                 const Ranks& ranks,
+                 double threshold,
+                 const RootSlice& slice,
+                 std::vector<Workspace>& workspaces,
+                 SearchMonitor* monitor,
+                 RootSplit* root,
+                 FlatNode* tree) {
+  size_t num_features = ranks.num_features();
+  size_t num_points = sorted_sets.size();
+  Workspace& workspace = workspaces[0];
+  std::vector<size_t> features = root_feature_order(sorted_sets, options, rewards, ranks, slice, workspace);
+  size_t end = std::min(slice.end, num_points - 1);
+  size_t begin = std::min(slice.begin, end);
+  size_t num_candidates = depth > 0 ? features.size() * (end - begin) : 0;
+  if (monitor != nullptr) {
+    monitor->start_search(depth, num_candidates);
+  }
+  RootSplit best_root;
+  best_root.num_candidates = num_candidates;
+  if (workspace.level_stats(depth) != nullptr) {
+    workspace.level_stats(depth)->num_nodes++;
+  }
+
+  if (depth == 0) {
+    level_zero_learning(sorted_sets, rewards, workspace, tree);
+  } else if (depth == 1) {
+    std::vector<LevelOneSplit> feature_best(num_features);
+    auto search_feature = [&](size_t i, Workspace& thread_workspace) {
+      size_t p = features[i];
+      if (monitor == nullptr || !monitor->is_cancelled()) {
+        ScopedTimer timer(thread_workspace.feature_seconds(p));
+        level_one_feature(p, sorted_sets, rewards, ranks, thread_workspace.sum_array, options,
+                          begin, end, feature_best[p], thread_workspace.level_stats(1));
+      }
+      if (monitor != nullptr) {
+        monitor->update_best(feature_best[p].reward);
+        monitor->advance(end - begin);
+      }
+    };
+    if (workspaces.size() <= 1) {
+      for (size_t i = 0; i < features.size(); i++) {
+        search_feature(i, workspace);
+      }
+    } else {
+      parallel_search(features.size(), workspaces, monitor, search_feature);
+    }
+    LevelOneSplit best;
+    for (size_t p = 0; p < num_features; p++) {
+      if (best.reward < feature_best[p].reward) {
+        best = feature_best[p];
+      }
+    }
+    if (best.reward > -INF) {
+      best_root.found = true;
+      best_root.reward = best.reward;
+      best_root.feature = best.split_var;
+      best_root.position = best.position;
+    }
+    level_one_tree(best, sorted_sets, rewards, workspace, tree);
+  } else {
+    double node_bound = reward_bound(sorted_sets, rewards);
+    const Split* best = &workspace.levels[depth].best;
+    std::vector<Split> feature_best;
+    if (depth == 2 && use_level_two(workspace.level_two, sorted_sets, ranks.num_features())) {
+      level_two_node(sorted_sets, rewards, ranks, workspace.level_two);
+      for (size_t i = 1; i < workspaces.size(); i++) {
+        LevelTwoWorkspace& buckets = workspaces[i].level_two;
+        buckets.node_sums = workspace.level_two.node_sums;
+        buckets.node_counts = workspace.level_two.node_counts;
+        buckets.node_total = workspace.level_two.node_total;
+        buckets.node_size = workspace.level_two.node_size;
+      }
+    }
+    if (workspaces.size() <= 1) {
+      // sequentially, all root features share one incumbent
+      Split& shared_best = workspace.levels[depth].best;
+      shared_best.found = false;
+      for (size_t p : features) {
+        ScopedTimer timer(workspace.feature_seconds(p));
+        find_best_split_feature(p, sorted_sets, depth, options, rewards, ranks, node_bound, threshold,
+                                begin, end, workspace, shared_best);
+      }
+    } else {
+      // The tasks are searched in parallel (the largest first, unless the features are searched in the
+      // order given by `root_feature_order`), and their best splits reduced in feature and position order.
+      std::vector<RootTask> tasks = root_tasks(sorted_sets, depth, ranks, features, begin, end,
+                                               workspaces.size(), workspace);
+      std::vector<size_t> order(tasks.size());
+      std::vector<size_t> feature_rank(num_features);
+      for (size_t i = 0; i < features.size(); i++) {
+        feature_rank[features[i]] = i;
+      }
+      for (size_t i = 0; i < tasks.size(); i++) {
+        order[i] = i;
+      }
+      bool limited = options.time_limit > 0 || options.max_evaluations > 0;
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (limited) {
+          return feature_rank[tasks[a].feature] < feature_rank[tasks[b].feature];
         }
-        auto left_child = find_best_split(left_sorted_sets, level - 1, split_step, min_node_size, data, sum_array);
-        auto right_child = find_best_split(right_sorted_sets, level - 1, split_step, min_node_size, data, sum_array);
-        if ((best_left_child == nullptr) ||
-            (left_child->reward + right_child->reward >
-              best_left_child->reward + best_right_child->reward)) {
-          best_left_child = std::move(left_child);
-          best_right_child = std::move(right_child);
-          best_split_var = p;
-          best_split_val = point_bk.get_value(p);
+        return tasks[a].num_candidates > tasks[b].num_candidates;
+      });
+      SharedIncumbent incumbent;
+      for (auto& thread_workspace : workspaces) {
+        thread_workspace.root_incumbent = options.bound_pruning ? &incumbent : nullptr;
+        thread_workspace.root_level = depth;
+      }
+      feature_best.assign(tasks.size(), Split(depth));
+      parallel_search(tasks.size(), workspaces, monitor,
+        [&](size_t i, Workspace& thread_workspace) {
+          const RootTask& task = tasks[order[i]];
+          ScopedTimer timer(thread_workspace.feature_seconds(task.feature));
+          find_best_split_feature(task.feature, sorted_sets, depth, options, rewards, ranks, node_bound, threshold,
+                                  task.begin, task.end, thread_workspace, feature_best[order[i]]);
+        });
+      for (auto& thread_workspace : workspaces) {
+        thread_workspace.root_incumbent = nullptr;
+      }
+      best = &feature_best[0];
+      for (size_t i = 1; i < tasks.size(); i++) {
+        const Split& candidate = feature_best[i];
+        if (candidate.found && (!best->found || candidate.tree[0].reward > best->tree[0].reward)) {
+          best = &candidate;
         }
       }
     }
-    if (best_left_child == nullptr) {
-      return level_zero_learning(sorted_sets, data);
-    } else {
-          // "pruning", the recursive case (same action in both leaves):
-      if ((best_left_child->is_leaf() && best_right_child->is_leaf()) &&
-              (best_left_child->action_id == best_right_child->action_id)) {
-        double leaf_reward = best_left_child->reward + best_right_child->reward;
-        size_t leaf_action = best_left_child->action_id;
-        best_ans_as_leaf = std::unique_ptr<Node> (new Node(0, 0.0, leaf_reward, leaf_action));
-        return best_ans_as_leaf;
-      } else {
-        double best_reward = best_left_child->reward + best_right_child->reward;
-        auto ret = std::unique_ptr<Node> (new Node(best_split_var, best_split_val, best_reward, 0));
-        ret->left_child = std::move(best_left_child);
-        ret->right_child = std::move(best_right_child);
-        return ret;
+    if (best->found) {
+      best_root.found = true;
+      best_root.reward = best->tree[0].reward;
+      best_root.feature = best->tree[0].index;
+      best_root.position = best->position;
+    }
+    split_tree(*best, depth, sorted_sets, rewards, workspace, tree);
+  }
+  if (root != nullptr) {
+    *root = best_root;
+  }
+}
+
+
+// The state shared by every tree search on a data set: the compressed features, the rewards,
+// the root sorted sets, and a workspace per thread.
+template <typename Ranks>
+struct SearchContext {
+  SearchContext(int depth,
+                const SearchOptions& options,
+                const Ranks& ranks,
+                const SortedSets& sorted_sets,
+                const RewardRows& rewards) :
+  ranks(ranks),
+  rewards(rewards),
+  sorted_sets(sorted_sets),
+  monitor(options) {
+    if (sorted_sets.size() == 0) {
+      throw std::invalid_argument("Every sample has weight zero.");
+    }
+    size_t num_threads = options.num_threads;
+    if (num_threads == 0) {
+      num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    // (at depth >= 2 the root features are divided into ranges of split positions, see `root_tasks`)
+    size_t max_threads = depth >= 2 ? ranks.num_samples() : ranks.num_features();
+    Workspace workspace(depth, sorted_sets.size(), ranks, rewards);
+    if (workspace.memory() > 0) {
+      max_threads = std::min(max_threads, options.workspace_memory / workspace.memory());
+    }
+    num_threads = std::max(std::min(num_threads, max_threads), static_cast<size_t>(1));
+    workspaces.assign(num_threads, workspace);
+    // a depth two search never reaches a depth one node twice (each is the child of one root split)
+    if (depth >= 3 && options.cache_memory > 0) {
+      for (auto& workspace : workspaces) {
+        workspace.level_one_cache.reset(2 * ranks.num_features() + 1, options.cache_memory / num_threads);
+      }
+    }
+    if (options.progress || options.time_limit > 0 || options.max_evaluations > 0) {
+      for (auto& workspace : workspaces) {
+        workspace.monitor = &monitor;
+      }
+    }
+    if (options.profile) {
+      for (auto& workspace : workspaces) {
+        workspace.stats.levels.assign(depth + 1, LevelStats());
+        workspace.stats.feature_seconds.assign(ranks.num_features(), 0.0);
+      }
+    }
+  }
+
+  // The monitor of the search (null without a progress callback or a limit)
+  SearchMonitor* get_monitor() {
+    return workspaces[0].monitor;
+  }
+
+  // The search counters summed over all threads, and whether the search ran to completion
+  // (with profiling, the root level's time is that spent on the root features)
+  SearchStats get_stats() const {
+    SearchStats stats;
+    stats.levels.resize(workspaces[0].stats.levels.size());
+    stats.feature_seconds.resize(workspaces[0].stats.feature_seconds.size());
+    for (const auto& workspace : workspaces) {
+      stats.num_subtrees += workspace.stats.num_subtrees;
+      stats.num_pruned += workspace.stats.num_pruned;
+      stats.num_cache_hits += workspace.stats.num_cache_hits;
+      stats.num_cache_misses += workspace.stats.num_cache_misses;
+      for (size_t level = 0; level < stats.levels.size(); level++) {
+        stats.levels[level] += workspace.stats.levels[level];
+      }
+      for (size_t p = 0; p < stats.feature_seconds.size(); p++) {
+        stats.feature_seconds[p] += workspace.stats.feature_seconds[p];
+      }
+    }
+    if (!stats.levels.empty()) {
+      for (double seconds : stats.feature_seconds) {
+        stats.levels.back().seconds += seconds;
+      }
+    }
+    stats.complete = !monitor.is_stopped();
+    stats.fraction_searched = monitor.fraction_searched();
+    return stats;
+  }
+
+  const Ranks& ranks;
+  const RewardRows& rewards;
+  SortedSets sorted_sets;
+  SearchMonitor monitor;
+  std::vector<Workspace> workspaces;
+};
+
+
+/**
+ * Run `search(ranks)` with the ranks stored in the narrowest unsigned type that holds them.
+ *
+ * The sweeps read the rank of every sample they pass, so for features with at most 256 (65536)
+ * distinct values storing them in 8 (16) bits cuts the memory the search streams through by 4 (2)x.
+ * `ranks` is released before the search runs (which may take over the narrowed ranks).
+ */
+template <typename Search>
+typename Search::result_type with_narrowest_ranks(SampleRanks<uint32_t> ranks, const Search& search) {
+  size_t max_num_values = 0;
+  for (size_t j = 0; j < ranks.num_features(); j++) {
+    max_num_values = std::max(max_num_values, ranks.num_values(j));
+  }
+
+  if (max_num_values <= std::numeric_limits<uint8_t>::max() + static_cast<size_t>(1)) {
+    SampleRanks<uint8_t> narrow_ranks(ranks);
+    ranks = SampleRanks<uint32_t>();
+    return search(narrow_ranks);
+  } else if (max_num_values <= std::numeric_limits<uint16_t>::max() + static_cast<size_t>(1)) {
+    SampleRanks<uint16_t> narrow_ranks(ranks);
+    ranks = SampleRanks<uint32_t>();
+    return search(narrow_ranks);
+  }
+  return search(ranks);
+}
+
+
+/**
+ * Exact tree search over the root splits in `slice` (as a function object, to be called with any rank type)
+ *
+ * With an incumbent (`SearchOptions::incumbent`), the root is searched with a threshold just below
+ * it, so bound pruning starts from it instead of from the first candidate. If the best tree does not
+ * exceed the threshold, no tree in the search space reaches the incumbent (e.g. it was fit with
+ * other tuning parameters) and the result can not be trusted, so the search is repeated without it.
+ */
+struct TreeSearch {
+  typedef std::unique_ptr<Node> result_type;
+
+  TreeSearch(int depth,
+             const SearchOptions& options,
+             const RewardRows& rewards,
+             const double* weights,
+             const RootSlice& slice,
+             RootSplit* root,
+             SearchStats* stats) :
+  depth(depth), options(options), rewards(rewards), weights(weights), slice(slice), root(root), stats(stats) {}
+
+  template <typename Ranks>
+  std::unique_ptr<Node> operator()(const Ranks& ranks) const {
+    std::vector<uint32_t> storage;
+    return search(ranks, create_sorted_sets(ranks, weights, storage));
+  }
+
+  // Search with precomputed root sorted sets (of the samples with a positive weight)
+  template <typename Ranks>
+  std::unique_ptr<Node> search(const Ranks& ranks, const SortedSets& sorted_sets) const {
+    SearchContext<Ranks> context(depth, options, ranks, sorted_sets, rewards);
+    std::vector<FlatNode> tree(flat_tree_size(depth));
+    double threshold = -INF;
+    if (options.bound_pruning && options.incumbent > -INF) {
+      // (the incumbent and the rewards the search computes are sums with rounding errors below the slack)
+      threshold = options.incumbent - 2 * rewards.bound_slack();
+    }
+    search_tree(sorted_sets, depth, options, rewards, ranks, threshold, slice, context.workspaces,
+                context.get_monitor(), root, tree.data());
+    if (threshold > -INF && !(tree[0].reward > threshold) && !context.monitor.is_stopped()) {
+      context.monitor.restart_search();
+      search_tree(sorted_sets, depth, options, rewards, ranks, -INF, slice, context.workspaces,
+                  context.get_monitor(), root, tree.data());
+    }
+    context.monitor.check();
+    if (stats != nullptr) {
+      *stats = context.get_stats();
+    }
+
+    return unflatten_tree(tree.data(), depth);
+  }
+
+  int depth;
+  const SearchOptions& options;
+  const RewardRows& rewards;
+  const double* weights;
+  const RootSlice& slice;
+  RootSplit* root;
+  SearchStats* stats;
+};
+
+
+template <typename DataType>
+std::unique_ptr<Node> tree_search(int depth,
+                                  const SearchOptions& options,
+                                  const DataType* data,
+                                  SearchStats* stats) {
+  if (!options.collapse_duplicates) {
+    return partial_tree_search(depth, options, RootSlice(), data, nullptr, stats);
+  }
+
+  RewardRows rewards = create_reward_rows(data);
+  SampleRanks<uint32_t> ranks = compress_features(data, options.max_bins);
+  const double* weights = data->get_weights();
+  if (collapse_duplicates(ranks, rewards, weights)) {
+    weights = nullptr;
+  }
+  RootSlice slice;
+  return with_narrowest_ranks(std::move(ranks), TreeSearch(depth, options, rewards, weights, slice, nullptr, stats));
+}
+
+
+template <typename DataType>
+std::unique_ptr<Node> partial_tree_search(int depth,
+                                          const SearchOptions& options,
+                                          const RootSlice& slice,
+                                          const DataType* data,
+                                          RootSplit* root,
+                                          SearchStats* stats) {
+  // The search runs on the features coordinate compressed to integer ranks
+  RewardRows rewards = create_reward_rows(data);
+  return with_narrowest_ranks(compress_features(data, options.max_bins),
+                              TreeSearch(depth, options, rewards, data->get_weights(), slice, root, stats));
+}
+
+
+// A search index with the ranks stored as `Ranks`
+template <typename Ranks>
+class RankIndex : public SearchIndex {
+public:
+  explicit RankIndex(Ranks& ranks_to_take) :
+  ranks(std::move(ranks_to_take)),
+  sorted_sets(create_sorted_sets(ranks, nullptr, storage)) {
+  }
+
+  size_t num_samples() const {
+    return ranks.num_samples();
+  }
+
+  size_t num_features() const {
+    return ranks.num_features();
+  }
+
+  std::unique_ptr<Node> search(int depth,
+                               const SearchOptions& options,
+                               const RewardSet& reward_set,
+                               SearchStats* stats) const {
+    Data data(nullptr, reward_set.rewards, ranks.num_samples(), 0, reward_set.num_rewards);
+    data.set_weights(reward_set.weights);
+    RewardRows rewards = create_reward_rows(&data);
+    RootSlice slice;
+    TreeSearch search(depth, options, rewards, reward_set.weights, slice, nullptr, stats);
+    if (reward_set.weights == nullptr) {
+      return search.search(ranks, sorted_sets);
+    }
+
+    // the index's sorted sets are of all samples
+    std::vector<uint32_t> subset_storage;
+    return search.search(ranks, positive_weight_sets(sorted_sets, ranks.num_features(), reward_set.weights,
+                                                     subset_storage));
+  }
+
+private:
+  Ranks ranks;
+  std::vector<uint32_t> storage;
+  SortedSets sorted_sets;
+};
+
+
+// Creates a search index that takes over the ranks (as a function object, to be called with any rank type)
+struct CreateSearchIndex {
+  typedef std::unique_ptr<SearchIndex> result_type;
+
+  template <typename Ranks>
+  std::unique_ptr<SearchIndex> operator()(Ranks& ranks) const {
+    return std::unique_ptr<SearchIndex>(new RankIndex<Ranks>(ranks));
+  }
+};
+
+
+template <typename DataType>
+std::unique_ptr<SearchIndex> create_search_index(const DataType* data, size_t max_bins) {
+  return with_narrowest_ranks(compress_features(data, max_bins), CreateSearchIndex());
+}
+
+
+/**
+ * The searches are handed out to worker threads one at a time from a shared counter, like the root
+ * features of a single search (see `parallel_search`). The workers' searches check a shared
+ * flag from their own (per search) progress callbacks, so a cancellation or an error on any thread
+ * stops all of them at their next split candidate.
+ */
+std::vector<std::unique_ptr<Node>> SearchIndex::search_batch(int depth,
+                                                             const SearchOptions& options,
+                                                             const std::vector<RewardSet>& reward_sets,
+                                                             std::vector<SearchStats>* stats) const {
+  typedef std::chrono::steady_clock Clock;
+  size_t num_searches = reward_sets.size();
+  std::vector<std::unique_ptr<Node>> trees(num_searches);
+  std::vector<SearchStats> search_stats(num_searches);
+  size_t num_threads = options.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  size_t num_workers = std::max(std::min(num_threads, num_searches), static_cast<size_t>(1));
+
+  std::atomic<bool> cancelled(false);
+  SearchOptions search_options = options;
+  search_options.num_threads = std::max(num_threads / num_workers, static_cast<size_t>(1));
+  search_options.cache_memory = options.cache_memory / num_workers;
+  search_options.workspace_memory = options.workspace_memory / num_workers;
+  search_options.progress = [&cancelled](const SearchProgress&) {
+    return !cancelled.load(std::memory_order_relaxed);
+  };
+
+  std::atomic<size_t> next_search(0);
+  std::atomic<size_t> num_completed(0);
+  std::atomic<size_t> num_running(num_workers);
+  // the first error of a search (the searches it cancels throw `SearchCancelled` after it)
+  std::atomic<bool> failed(false);
+  std::exception_ptr search_error;
+  auto worker = [&]() {
+    for (size_t b = next_search++; b < num_searches && !cancelled; b = next_search++) {
+      try {
+        trees[b] = search(depth, search_options, reward_sets[b], &search_stats[b]);
+        num_completed++;
+      } catch (...) {
+        if (!failed.exchange(true)) {
+          search_error = std::current_exception();
+        }
+        cancelled = true;
       }
     }
+    num_running--;
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_workers);
+  for (size_t w = 0; w < num_workers; w++) {
+    threads.push_back(std::thread(worker));
+  }
+  std::exception_ptr error;
+  bool user_cancelled = false;
+  Clock::time_point start = Clock::now();
+  Clock::time_point last_poll = start;
+  while (num_running.load() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Clock::time_point now = Clock::now();
+    if (!options.progress || cancelled || std::chrono::duration<double>(now - last_poll).count() < options.progress_interval) {
+      continue;
+    }
+    last_poll = now;
+    SearchProgress progress;
+    progress.num_evaluated = num_completed.load();
+    progress.num_candidates = num_searches;
+    progress.elapsed = std::chrono::duration<double>(now - start).count();
+    progress.best_reward = -INF;
+    try {
+      user_cancelled = !options.progress(progress);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    if (user_cancelled || error) {
+      cancelled = true;
+    }
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // an error in the callback or a cancellation takes precedence over the searches it cancelled
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  if (user_cancelled) {
+    throw SearchCancelled();
+  }
+  if (search_error) {
+    std::rethrow_exception(search_error);
+  }
+  if (stats != nullptr) {
+    *stats = search_stats;
+  }
+
+  return trees;
+}
+
+
+/**
+ * Grow the hybrid tree below a node at `level`, with samples `sorted_sets`.
+ *
+ * The node is split by the root of the best depth `search_depth` tree on its samples. Its two
+ * children are grown the same way, until the best tree is a leaf or the look-ahead reaches
+ * `depth`, where the entire best tree is attached. The sorted sets of the children are
+ * partitions of the node's (stored in `buffers[level]`), so samples are never copied or re-sorted.
+ */
+template <typename Ranks>
+std::unique_ptr<Node> hybrid_node(const SortedSets& sorted_sets,
+                                  int level,
+                                  int depth,
+                                  int search_depth,
+                                  const SearchOptions& options,
+                                  SearchContext<Ranks>& context,
+                                  std::vector<std::vector<uint32_t>>& buffers) {
+  const Ranks& ranks = context.ranks;
+  std::vector<FlatNode> tree(flat_tree_size(search_depth));
+  SearchMonitor* monitor = context.get_monitor();
+  search_tree(sorted_sets, search_depth, options, context.rewards, ranks, -INF, RootSlice(), context.workspaces,
+              monitor, nullptr, tree.data());
+  if (tree[0].is_leaf || level + search_depth >= depth || (monitor != nullptr && monitor->is_cancelled())) {
+    return unflatten_tree(tree.data(), search_depth);
   }
+
+  // samples with value <= split value go left
+  size_t p = tree[0].index;
+  double split_value = tree[0].value;
+  const uint32_t* setp = sorted_sets.begin(p);
+  size_t num_left = std::upper_bound(setp, setp + sorted_sets.size(), split_value,
+    [&](double value, uint32_t sample) {
+      return value < ranks.get_value(p, ranks.get(sample, p));
+    }) - setp;
+  uint32_t* children = buffers[level].data();
+  SortedSets left_sorted_sets(children, num_left);
+  SortedSets right_sorted_sets(children + ranks.num_features() * num_left, sorted_sets.size() - num_left);
+  partition_sorted_sets(sorted_sets, p, ranks, left_sorted_sets, right_sorted_sets);
+
+  auto node = std::unique_ptr<Node> (new Node(p, split_value, 0.0, 0));
+  node->left_child = hybrid_node(left_sorted_sets, level + 1, depth, search_depth, options, context, buffers);
+  node->right_child = hybrid_node(right_sorted_sets, level + 1, depth, search_depth, options, context, buffers);
+  node->reward = node->left_child->reward + node->right_child->reward;
+
+  return node;
 }
 
-std::unique_ptr<Node> tree_search(int depth, int split_step, size_t min_node_size, const Data* data) {
-  size_t num_rewards = data->num_rewards();
-  size_t num_points = data->num_rows;
-  auto sorted_sets = create_sorted_sets(data);
 
-  std::vector<std::vector<double>> sum_array;
-  sum_array.resize(num_rewards);
-  for (auto& v : sum_array) {
-    // + 1 because this is a cumulative sum of rewards, entry 0 will be zero.
-    v.resize(num_points + 1, 0.0);
+// Hybrid tree search (as a function object, to be called with any rank type)
+struct HybridTreeSearch {
+  typedef std::unique_ptr<Node> result_type;
+
+  HybridTreeSearch(int depth, int search_depth, const SearchOptions& options, const RewardRows& rewards,
+                   const double* weights, SearchStats* stats) :
+  depth(depth), search_depth(search_depth), options(options), rewards(rewards), weights(weights), stats(stats) {}
+
+  template <typename Ranks>
+  std::unique_ptr<Node> operator()(const Ranks& ranks) const {
+    std::vector<uint32_t> storage;
+    SearchContext<Ranks> context(search_depth, options, ranks, create_sorted_sets(ranks, weights, storage), rewards);
+    // the sorted sets of the children of the nodes at each level that is split (in turn)
+    std::vector<std::vector<uint32_t>> buffers(std::max(depth - search_depth, 0));
+    for (auto& buffer : buffers) {
+      buffer.resize(storage.size());
+    }
+    auto root = hybrid_node(context.sorted_sets, 0, depth, search_depth, options, context, buffers);
+    context.monitor.check();
+    if (stats != nullptr) {
+      *stats = context.get_stats();
+    }
+
+    return root;
   }
 
-  return find_best_split(sorted_sets, depth, split_step, min_node_size, data, sum_array);
+  int depth;
+  int search_depth;
+  const SearchOptions& options;
+  const RewardRows& rewards;
+  const double* weights;
+  SearchStats* stats;
+};
+
+
+template <typename DataType>
+std::unique_ptr<Node> hybrid_tree_search(int depth,
+                                         int search_depth,
+                                         const SearchOptions& options,
+                                         const DataType* data,
+                                         SearchStats* stats) {
+  RewardRows rewards = create_reward_rows(data);
+  return with_narrowest_ranks(compress_features(data, options.max_bins),
+                              HybridTreeSearch(depth, search_depth, options, rewards, data->get_weights(), stats));
 }
+
+
+// The data types the search is compiled for
+template DataSummary summarize_data<Data>(const Data*, bool);
+template DataSummary summarize_data<IntegerData>(const IntegerData*, bool);
+template std::vector<std::vector<size_t>> feature_value_counts<Data>(const Data*, size_t);
+template std::vector<std::vector<size_t>> feature_value_counts<IntegerData>(const IntegerData*, size_t);
+template std::unique_ptr<Node> tree_search<Data>(int, const SearchOptions&, const Data*, SearchStats*);
+template std::unique_ptr<Node> tree_search<IntegerData>(int, const SearchOptions&, const IntegerData*, SearchStats*);
+template std::unique_ptr<Node> partial_tree_search<Data>(int, const SearchOptions&, const RootSlice&, const Data*,
+                                                        RootSplit*, SearchStats*);
+template std::unique_ptr<Node> partial_tree_search<IntegerData>(int, const SearchOptions&, const RootSlice&,
+                                                               const IntegerData*, RootSplit*, SearchStats*);
+template std::unique_ptr<SearchIndex> create_search_index<Data>(const Data*, size_t);
+template std::unique_ptr<SearchIndex> create_search_index<IntegerData>(const IntegerData*, size_t);
+template std::unique_ptr<Node> hybrid_tree_search<Data>(int, int, const SearchOptions&, const Data*, SearchStats*);
+template std::unique_ptr<Node> hybrid_tree_search<IntegerData>(int, int, const SearchOptions&, const IntegerData*,
+                                                               SearchStats*);
@@ -1,6 +1,8 @@
 #ifndef TREE_SEARCH_H
 #define TREE_SEARCH_H
 
+#include <cstdint>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <stdexcept>
@@ -8,23 +10,41 @@
 
 const double INF = std::numeric_limits<double>::infinity();
 
-// Data class for column major storage
-class Data {
+/**
+ * Data class for column major storage
+ *
+ * The features are stored as `FeatureType` and the rewards as `RewardType`, so that the input
+ * matrices are read in their own storage type without a (converted) copy.
+ *
+ * Optional non-negative sample weights (`set_weights`) multiply each sample's rewards, and samples
+ * with weight zero are left out of the search, so a subset of the rows is searched without copying it.
+ */
+template <typename FeatureType, typename RewardType>
+class BasicData {
 public:
-  Data(const double* data_x,
-       const double* data_y,
-       size_t num_rows,
-       size_t num_cols_x,
-       size_t num_cols_y) :
-  num_rows(num_rows), data_x(data_x), data_y(data_y),
+  BasicData(const FeatureType* data_x,
+            const RewardType* data_y,
+            size_t num_rows,
+            size_t num_cols_x,
+            size_t num_cols_y) :
+  num_rows(num_rows), data_x(data_x), data_y(data_y), weights(nullptr),
   num_cols_x(num_cols_x), num_cols_y(num_cols_y) {
   }
 
-  double get_x(size_t row, size_t col) const {
+  // Set the sample weights (null for unit weights)
+  void set_weights(const double* sample_weights) {
+    weights = sample_weights;
+  }
+
+  const double* get_weights() const {
+    return weights;
+  }
+
+  FeatureType get_x(size_t row, size_t col) const {
     return data_x[col * num_rows + row];
   }
 
-  double get_y(size_t row, size_t col) const {
+  RewardType get_y(size_t row, size_t col) const {
     return data_y[col * num_rows + row];
   }
 
@@ -39,34 +59,17 @@ public:
   size_t num_rows;
 
 private:
-  const double* data_x;
-  const double* data_y;
+  const FeatureType* data_x;
+  const RewardType* data_y;
+  const double* weights;
   size_t num_cols_x;
   size_t num_cols_y;
 };
 
-
-// A point is a row in the [X Y] matrix
-class Point {
-public:
-  Point (size_t sample, const Data* data) :
-  sample(sample), data(data) {}
-
-  // i is the column index of the feature matrix
-  double get_value(size_t i) const {
-    return data->get_x(sample, i);
-  }
-
-  // j is the column index of the reward
-  double get_reward(size_t j) const {
-    return data->get_y(sample, j);
-  }
-
-  size_t sample;
-
-private:
-  const Data* data;
-};
+// Double features (R numeric matrices)
+typedef BasicData<double, double> Data;
+// 32-bit integer features (R integer matrices, where the smallest value is NA)
+typedef BasicData<int32_t, double> IntegerData;
 
 
 struct Node {
@@ -91,6 +94,270 @@ struct Node {
 };
 
 
-std::unique_ptr<Node> tree_search(int, int, size_t, const Data*);
+// The input checks computed by `summarize_data`
+struct DataSummary {
+  DataSummary() : missing_x(false), missing_y(false) {}
+
+  // Whether any feature (reward) is missing (NaN)
+  bool missing_x;
+  bool missing_y;
+  // The number of distinct values of each feature (empty if not requested)
+  std::vector<size_t> cardinality;
+};
+
+// Check the data in one pass over each column, counting distinct feature values if `count_distinct`
+// (`DataType` is `Data` or `IntegerData`, as for the searches below)
+template <typename DataType>
+DataSummary summarize_data(const DataType* data, bool count_distinct);
+
+// The number of samples of each distinct value of every feature, in increasing order of the values (of
+// the bins, if `max_bins` > 0, see `SearchOptions::max_bins`)
+template <typename DataType>
+std::vector<std::vector<size_t>> feature_value_counts(const DataType* data, size_t max_bins);
+
+// The number of split positions along a feature whose distinct values have `value_counts` samples (in
+// increasing order of the values) that a node of these samples evaluates, with `split_step` and
+// `min_node_size` as in `SearchOptions`
+size_t count_split_candidates(const std::vector<size_t>& value_counts, int split_step, size_t min_node_size);
+
+// A snapshot of a running tree search (see `SearchOptions::progress`)
+struct SearchProgress {
+  // The number of root split positions searched, out of `num_candidates` (num_features * (N - 1))
+  size_t num_evaluated;
+  size_t num_candidates;
+  // The seconds since the search started
+  double elapsed;
+  // The reward of the best tree found so far (-INF if none)
+  double best_reward;
+};
+
+// Thrown by a tree search that was cancelled by its progress callback
+class SearchCancelled : public std::runtime_error {
+public:
+  SearchCancelled() : std::runtime_error("Tree search was cancelled.") {}
+};
+
+// The tuning parameters of tree search
+struct SearchOptions {
+  SearchOptions() :
+  split_step(1), min_node_size(1), max_bins(0), bound_pruning(true), num_threads(1),
+  time_limit(0), max_evaluations(0), incumbent(-INF), cache_memory(64 << 20),
+  workspace_memory(static_cast<size_t>(1) << 31), collapse_duplicates(false), profile(false),
+  progress_interval(1.0) {
+  }
+
+  // Only split at every `split_step`th sample along a feature
+  int split_step;
+  // The smallest number of samples in a leaf
+  size_t min_node_size;
+  // If greater than zero, bin each feature into at most `max_bins` (quantile) bins
+  size_t max_bins;
+  // Skip subtrees whose reward bound can not beat the best tree found so far (this is exact)
+  bool bound_pruning;
+  // The number of threads (0 uses all available cores)
+  size_t num_threads;
+  // If greater than zero, stop searching after `time_limit` seconds, or once `max_evaluations` root
+  // split positions have been searched, and return the best tree found so far (`SearchStats::complete`
+  // is then false). With a limit, the root features are searched in order of their best depth one
+  // reward, so that good splits are found early. (If the limit is not hit the tree is optimal, but
+  // ties between equally good trees may be broken differently than without a limit.)
+  double time_limit;
+  size_t max_evaluations;
+  // The reward of a tree known to be in the search space (e.g. the previous tree on updated rewards),
+  // which bound pruning starts from, or -INF. This does not change the result: if the search finds
+  // no tree with (about) this reward, it is repeated without it.
+  double incumbent;
+  // The bytes (divided between the threads) to cache the depth one subtrees of a depth >= 3 search in,
+  // so that a node reached again by another path of splits (e.g. x1 then x2, and x2 then x1) is not
+  // searched again (0 disables the cache). This does not change the result.
+  size_t cache_memory;
+  // The bytes the threads' scratch memory may take up in all (at least one thread is used). Each thread
+  // allocates about 4 n p (depth - 1) + 8 n d bytes for the sorted sets and reward sums of its search
+  // (for n samples, p features, and d actions), so with many samples and features the number of threads
+  // is reduced to fit. This does not change the result.
+  size_t workspace_memory;
+  // Search the distinct rows of the (binned) features, each with the sum of the rewards and the count
+  // of its samples, instead of every sample (only used by `tree_search`). This does not change the
+  // result (up to the rounding of the reward sums), but with few distinct rows it shrinks the search,
+  // whose root split positions (see `SearchProgress`) then are those of the distinct rows.
+  bool collapse_duplicates;
+  // Count the split positions each level of the recursion evaluates and skips, and time the levels and
+  // root features (see `SearchStats::levels`). This does not change the result, but the timing adds
+  // two clock reads per node.
+  bool profile;
+  // If set, called by the thread that started the search about every `progress_interval` seconds.
+  // Returning false cancels the search, which then throws `SearchCancelled` (an exception thrown
+  // by the callback is rethrown by the search once its threads have stopped).
+  std::function<bool(const SearchProgress&)> progress;
+  double progress_interval;
+};
+
+// The work done at the nodes of one level of the recursion (see `SearchOptions::profile`)
+struct LevelStats {
+  LevelStats() :
+  num_nodes(0), num_pruned(0), num_evaluated(0), num_ties(0), num_too_small(0), num_stepped_over(0),
+  num_partitioned(0), seconds(0) {}
+
+  LevelStats& operator+=(const LevelStats& other);
+
+  // The number of nodes searched (including those found in the cache), and of those pruned by their reward bound
+  size_t num_nodes;
+  size_t num_pruned;
+  // The number of split positions along the features of these nodes that were evaluated, and of those
+  // skipped: between two samples with the same value, leaving fewer than `min_node_size` samples on a
+  // side, or between every `split_step`th sample
+  size_t num_evaluated;
+  size_t num_ties;
+  size_t num_too_small;
+  size_t num_stepped_over;
+  // The number of sorted set entries written by partitioning nodes into the children of their split
+  // candidates (at level two nodes searched by rank, see `use_level_two`, only those of the candidates
+  // that are searched again over their samples, which happens unless the sums of rewards are exact)
+  size_t num_partitioned;
+  // The seconds spent at these nodes, including their subtrees (summed over the threads)
+  double seconds;
+};
+
+// Counters describing the work done by a tree search
+struct SearchStats {
+  SearchStats() :
+  num_subtrees(0), num_pruned(0), num_cache_hits(0), num_cache_misses(0), complete(true), fraction_searched(1) {}
+
+  // The number of child subtrees (of split candidates at depth >= 2 nodes) considered
+  size_t num_subtrees;
+  // The number of those subtrees skipped by bound pruning (or, at level two nodes searched by rank,
+  // because the rank sums show their candidate can not be selected)
+  size_t num_pruned;
+  // The number of depth one subtrees found in (and added to) the cache (see `SearchOptions::cache_memory`)
+  size_t num_cache_hits;
+  size_t num_cache_misses;
+  // Whether the search ran to completion (false if it stopped at `time_limit` or `max_evaluations`)
+  bool complete;
+  // The share of root split positions that were searched
+  double fraction_searched;
+  // With `SearchOptions::profile`, the work at each level of the recursion (index = the depth of
+  // the subtrees searched at the level, so `levels[depth]` is the root), and the seconds spent on
+  // the root splits along each feature (summed over the threads); otherwise empty
+  std::vector<LevelStats> levels;
+  std::vector<double> feature_seconds;
+};
+
+// Find the depth `depth` tree that maximizes the sum of rewards (`stats` may be null)
+template <typename DataType>
+std::unique_ptr<Node> tree_search(int depth, const SearchOptions& options, const DataType* data, SearchStats* stats);
+
+/**
+ * A slice of the root split candidates of a tree search: the splits along `features` (every feature
+ * if empty) at positions `begin` <= k < `end`, where split position k along a feature sends the
+ * first k + 1 samples in sorted order left (positions range from 0 to N - 2).
+ */
+struct RootSlice {
+  RootSlice() : begin(0), end(std::numeric_limits<size_t>::max()) {}
+
+  std::vector<size_t> features;
+  size_t begin;
+  size_t end;
+};
+
+/**
+ * The best root split of a slice, as found by `partial_tree_search`.
+ *
+ * The best tree over all root splits is the tree of the slice whose root split has the largest
+ * `reward`, with ties broken by the smallest `feature`, then the smallest `position`. (This is how
+ * `tree_search` breaks ties, so the merged tree is identical to it.) If no slice has a valid split,
+ * every slice returns the same tree, the best leaf.
+ */
+struct RootSplit {
+  RootSplit() : found(false), reward(-INF), feature(0), position(0), num_candidates(0) {}
+
+  // Whether the slice contains a valid split (otherwise the tree is the best leaf)
+  bool found;
+  // The reward of the best tree with its root split in the slice
+  double reward;
+  size_t feature;
+  size_t position;
+  // The number of root split positions in the slice
+  size_t num_candidates;
+};
+
+// Find the best depth `depth` tree whose root split is in `slice`, and describe its root split in `root`
+template <typename DataType>
+std::unique_ptr<Node> partial_tree_search(int depth,
+                                          const SearchOptions& options,
+                                          const RootSlice& slice,
+                                          const DataType* data,
+                                          RootSplit* root,
+                                          SearchStats* stats);
+
+/**
+ * The rewards of a search on a `SearchIndex`: a column major `num_samples()` x `num_rewards` matrix,
+ * and optionally a non-negative weight per sample that its rewards are multiplied by. Samples with
+ * weight zero are left out of the search (as if they had been removed from the data), so a subset
+ * of the samples is searched by giving the other samples weight zero.
+ */
+struct RewardSet {
+  RewardSet(const double* rewards, size_t num_rewards, const double* weights) :
+  rewards(rewards), num_rewards(num_rewards), weights(weights) {}
+
+  const double* rewards;
+  size_t num_rewards;
+  // null for unit weights
+  const double* weights;
+};
+
+/**
+ * The features of a data set prepared for tree search: coordinate compressed, and sorted along every
+ * feature (the O(p n log n) part of a search that does not depend on the rewards).
+ *
+ * An index can be searched any number of times with different rewards for the same samples, e.g.
+ * when the rewards are re-estimated while the features stay the same. It does not refer to the data
+ * it was created from, and can be searched from several threads at once.
+ */
+class SearchIndex {
+public:
+  virtual ~SearchIndex() {}
+
+  virtual size_t num_samples() const = 0;
+
+  virtual size_t num_features() const = 0;
+
+  // Find the depth `depth` tree that maximizes the sum of the rewards `rewards` (`options.max_bins`
+  // is ignored: the features were binned when the index was created)
+  virtual std::unique_ptr<Node> search(int depth,
+                                       const SearchOptions& options,
+                                       const RewardSet& rewards,
+                                       SearchStats* stats) const = 0;
+
+  /**
+   * Find the best tree for each of `reward_sets`, as `search` does, with the searches divided between
+   * `options.num_threads` threads (each search runs on one thread, unless there are fewer searches
+   * than threads), which also divide `options.cache_memory`. The trees do not depend on the number of threads.
+   *
+   * The progress callback is called from the calling thread, with the number of searches completed
+   * (`num_evaluated`) out of `num_candidates` = `reward_sets.size()`.
+   */
+  std::vector<std::unique_ptr<Node>> search_batch(int depth,
+                                                  const SearchOptions& options,
+                                                  const std::vector<RewardSet>& reward_sets,
+                                                  std::vector<SearchStats>* stats) const;
+};
+
+// Create the search index of the features in `data` (binned into at most `max_bins` bins if greater than zero)
+template <typename DataType>
+std::unique_ptr<SearchIndex> create_search_index(const DataType* data, size_t max_bins);
+
+// Find a depth `depth` tree greedily, splitting each node by the best depth `search_depth` tree
+template <typename DataType>
+std::unique_ptr<Node> hybrid_tree_search(int depth,
+                                         int search_depth,
+                                         const SearchOptions& options,
+                                         const DataType* data,
+                                         SearchStats* stats);
+
+#ifdef POLICYTREE_TEST_HOOKS
+// If set, called with the index of every task of a multi-threaded search on the worker thread that runs
+// it, before the task (only in builds of the tests, which use it to make a task fail)
+extern std::function<void(size_t)> parallel_search_task_hook;
+#endif
 
 #endif // TREE_SEARCH_H